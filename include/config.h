@@ -6,16 +6,58 @@
 #define GITHUB_USER "marcelloemme"
 #define GITHUB_REPO "MMpaper"
 
+// ===== CONTENT SERVER =====
+// Base URL per immagini, firmware.json e MMpaper.bin (senza "/" finale)
+// Sovrascrivibile da build flag, es. -DCONTENT_BASE_URL=\"http://192.168.1.10:8080\"
+#ifndef CONTENT_BASE_URL
+#define CONTENT_BASE_URL "https://raw.githubusercontent.com/" GITHUB_USER "/" GITHUB_REPO "/main"
+#endif
+
+// Accept-Encoding: gzip, deflate su metadata e immagini (decompressione in streaming,
+// finestra 32KB). Le richieste usano HTTP/1.0: niente chunked, body grezzo sullo stream
+#define ENABLE_HTTP_COMPRESSION true
+#define HTTP_INPUT_CHUNK 1024          // Buffer input compresso
+#define MAX_IMAGE_SIZE 2097152         // 2MB: limite buffer quando la dimensione non è nota
+
 // ===== AUTO-UPDATE SETTINGS =====
 // Firmware check: SOLO al boot (non più schedulato)
 #define MIN_BATTERY_PERCENT 30  // Non aggiornare se batteria < 30%
 
 // ===== IMAGE UPDATE SETTINGS =====
-// Check immagine: 6:00, 9:00, 12:00, 15:00, 18:00, 21:00, 00:00
+// Check immagine: 6:00, 9:00, 12:00, 15:00, 18:00, 21:00, 00:00 (+ slot del device)
 #define IMAGE_CHECK_HOURS {6, 9, 12, 15, 18, 21, 0}  // Orari check immagine
 #define IMAGE_CHECK_START_HOUR 6    // Inizio check giornalieri
 #define IMAGE_CHECK_END_HOUR 0      // Fine check (0 = mezzanotte)
 
+// Fleet: ogni device ha il suo slot nella finestra [ora di check, ora + finestra),
+// ricavato dal MAC (hash), più un ritardo casuale: i device non arrivano tutti a :00
+// image_meta.json può sovrascrivere "window_minutes" / "jitter_seconds" e indirizzare
+// contenuti per device o gruppo con "targets" (vedi README, "Fleet Manifest")
+#define DEVICE_GROUP ""                // Gruppo del device nel manifest ("" = nessuno)
+#define FETCH_WINDOW_MINUTES 30        // Finestra su cui si distribuiscono gli slot (max 60)
+#define FETCH_JITTER_SECONDS 60        // Ritardo casuale 0-60s aggiunto a ogni sleep
+#define FETCH_SLOT_TOLERANCE 300       // Wake entro 5 min (+ jitter) dallo slot = check valido
+
+// Formato "layered" (image/current.mmp, se image_meta.json ha "format": "layered")
+// Header 16 byte: "MMPL" + dimensione anteprima + dimensione JPEG completo (uint32 LE) + riservato
+// Poi anteprima JPEG a bassa risoluzione e JPEG completo: l'anteprima va a schermo
+// appena arriva (refresh veloce), il JPEG completo la rifinisce a download finito
+#define LAYERED_IMAGE_MAGIC "MMPL"
+#define LAYERED_HEADER_SIZE 16
+#define PREVIEW_ONLY_BATTERY_PERCENT 40  // Batteria sotto soglia: solo anteprima (no JPEG completo)
+
+// Formato "tiled" (image/current.mmt, se image_meta.json ha "format": "tiled")
+// Header 16 byte: "MMTL" + numero tile + larghezza + altezza (uint16 LE) + riservato
+// Indice (fa da manifest): per tile x, y, w, h (uint16) + offset, size (uint32) + MD5 (16 byte)
+// Poi i JPEG delle tile in coordinate pannello. Il device scarica via HTTP Range
+// solo le tile con MD5 nuovo e aggiorna a schermo solo l'area cambiata
+#define TILED_IMAGE_MAGIC "MMTL"
+#define TILED_HEADER_SIZE 16
+#define TILED_ENTRY_SIZE 32
+#define TILED_MAX_TILES 64
+#define TILED_MAX_RANGES 4           // Richieste Range max (tile vicine vengono unite)
+#define TILED_FULL_FETCH_PERCENT 70  // Se cambia più di così: scarica il file intero
+
 // ===== WIFI CREDENTIALS =====
 // Configurazione multi-WiFi con fallback
 // Il sistema prova tutte le reti in sequenza, fino a 3 tentativi totali
@@ -48,4 +90,86 @@ const WiFiNetwork WIFI_NETWORKS[WIFI_NETWORKS_COUNT] = {
 // ===== POWER MANAGEMENT =====
 #define ENABLE_IMU false  // Disabilita giroscopio di default (risparmio batteria)
 
+// Wake da pulsante (ext0/ext1): percorso veloce solo locale, la radio non si accende
+// - BUTTON_REDRAW_PIN (ext0): ridisegna l'immagine corrente dallo slot flash (qualità piena)
+// - BUTTON_NEXT_PIN (ext1): prossima immagine della playlist SD (refresh veloce)
+// GPIO RTC attivi bassi con pull-up, -1 = disabilitato
+#define ENABLE_BUTTON_WAKE true
+#if defined(ESP32S3)
+// M5PaperS3: nessun pulsante utente, collegare un pulsante a un GPIO RTC (0-21)
+#define BUTTON_REDRAW_PIN -1
+#define BUTTON_NEXT_PIN -1
+#else
+// M5Paper: rotella laterale (G37 su, G38 pressione, G39 giù)
+#define BUTTON_REDRAW_PIN 38
+#define BUTTON_NEXT_PIN 37
+#endif
+// Linea di wake extra attiva bassa su GPIO RTC (sensore esterno): ridisegno.
+// Il firmware non programma l'IMU (nessun any-motion/lift-to-wake): l'interrupt
+// va configurato dal sensore stesso. -1 = disabilitato
+#define MOTION_WAKE_PIN -1
+#define BUTTON_RELEASE_TIMEOUT 2000   // Pin ancora basso dopo 2s: escluso dai wake (bloccato)
+
+#if !defined(ESP32S3) && BUTTON_NEXT_PIN >= 0 && MOTION_WAKE_PIN >= 0
+// ESP32: ext1 sveglia solo quando TUTTI i pin sono bassi
+#error "M5Paper: BUTTON_NEXT_PIN e MOTION_WAKE_PIN non possono essere usati insieme"
+#endif
+
+// Light sleep automatico durante le attese di rete (WiFi, NTP, socket)
+// Richiede un core con CONFIG_PM_ENABLE e CONFIG_FREERTOS_USE_TICKLESS_IDLE.
+// Il core Arduino standard (framework = arduino) non ha il tickless idle:
+// esp_pm_configure rifiuta il light sleep e restano DFS (se c'è PM) e modem sleep
+#define ENABLE_LIGHT_SLEEP true
+#define CPU_MAX_FREQ_MHZ 240          // Frequenza durante decode/display
+#define CPU_MIN_FREQ_MHZ 40           // Frequenza minima (DFS) in idle
+#define NET_READ_TIMEOUT 10000        // 10s senza dati = download fallito
+#define NTP_SYNC_TIMEOUT 10000        // 10s max attesa sync NTP
+
+// ===== MICROSD CONTENT STORE =====
+// Mirror su microSD delle immagini scaricate + fallback offline
+// Indice: una riga per immagine "<md5> <size> <file>" (ordine = playlist)
+// Per precaricare contenuti basta copiare dei .jpg in SD_STORE_DIR
+#define ENABLE_SD_STORE true
+#define SD_STORE_DIR "/mmpaper"              // Cartella contenuti sulla SD
+#define SD_INDEX_FILE "/mmpaper/index.txt"   // File indice
+#define SD_READ_CHUNK 4096                   // Chunk lettura (buffer DMA interno)
+#define SD_SPI_FREQ 20000000                 // 20MHz
+
+#if defined(ESP32S3)
+// M5PaperS3: slot microSD su SPI dedicato
+#define SD_PIN_CS 47
+#define SD_PIN_SCK 39
+#define SD_PIN_MOSI 38
+#define SD_PIN_MISO 40
+#else
+// M5Paper: microSD condivide il bus SPI con il display
+#define SD_PIN_CS 4
+#define SD_PIN_SCK 14
+#define SD_PIN_MOSI 12
+#define SD_PIN_MISO 13
+#endif
+
+// ===== IMAGE SLOTS (FLASH A/B) =====
+// Due slot immagine in una partizione dati dedicata (partitions.csv): label e
+// subtype devono coincidere, così il firmware non cancella mai un filesystem altrui.
+// Senza la partizione (es. tabella del Launcher) gli slot restano disabilitati
+// Nuova immagine: MD5 verificato → scritta nello slot inattivo → riletta e
+// riverificata → attivata (header con seq più alto) solo se il decode riesce.
+// Decode fallito = rollback immediato allo slot attivo, senza rete
+#define ENABLE_IMAGE_SLOTS true
+#define IMAGE_SLOT_PARTITION "mmimages"       // Label partizione (partitions.csv: 3.4MB)
+#define IMAGE_SLOT_PARTITION_SUBTYPE 0x40    // Subtype dati custom (non spiffs/fat/littlefs)
+#define IMAGE_SLOT_HEADER_SIZE 4096     // Header in un settore flash dedicato
+
+// ===== RUNTIME CONFIG (NVS) =====
+// I valori sopra sono solo i default: un config.bin (make_config.py) pubblicato
+// accanto a image_meta.json ("config_seq") sostituisce orari di check, soglie
+// batteria, finestra/jitter di fetch, refresh, base URL, gruppo e reti WiFi extra.
+// Scaricato quando config_seq è più nuovo, validato (magic, versione, CRC, limiti),
+// salvato in NVS come "pending" e applicato al wake successivo: niente OTA
+#define ENABLE_RUNTIME_CONFIG true
+#define RUNTIME_CONFIG_VERSION 1
+#define RUNTIME_CONFIG_WIFI_MAX 3       // Reti WiFi nel blob (provate prima di WIFI_NETWORKS)
+#define RUNTIME_CONFIG_MAX_FAILS 3      // Metadata falliti di fila con base URL remoto: torna ai default
+
 #endif // CONFIG_H
@@ -0,0 +1,139 @@
+#!/usr/bin/env python3
+"""make_config.py - Build an MMpaper runtime config blob (config.bin)
+
+Options left out keep the compile-time defaults read from include/config.h.
+The blob is written next to image_meta.json (default image/config.bin) and the
+manifest's "config_seq" is bumped: devices download it at their next image
+check, validate it and apply it at the following wake.
+
+Layout (little-endian, 488 bytes, must match RuntimeConfig in src/main.cpp):
+    "MMCF" + version, size (uint16) + seq, check hours bitmask,
+    full refresh interval ms (uint32) + fetch jitter s (uint16) +
+    min battery %, preview-only battery %, fetch window min, partial refresh
+    max, WiFi count, reserved (uint8) + base URL (128) + device group (32) +
+    3 x WiFi ssid (33) / password (65) + 2 reserved bytes + CRC32
+"""
+
+import argparse
+import json
+import os
+import re
+import struct
+import sys
+import zlib
+
+REPO_DIR = os.path.dirname(os.path.abspath(__file__))
+VERSION = 1
+WIFI_MAX = 3
+LAYOUT = "<4sHHIIIHBBBBBB128s32s" + "33s65s" * WIFI_MAX + "2x"
+SIZE = struct.calcsize(LAYOUT) + 4
+
+
+def config_defaults():
+    """#define values from include/config.h (base URL: the firmware's own)."""
+    with open(os.path.join(REPO_DIR, "include", "config.h")) as f:
+        defines = dict(re.findall(r"^\s*#define (\w+) (.+?)(?:\s+//.*)?$", f.read(), re.M))
+
+    def string(name):
+        tokens = re.findall(r'"([^"]*)"|(\w+)', defines[name])
+        return "".join(literal if not macro else string(macro) for literal, macro in tokens)
+
+    hours = [int(h) for h in re.findall(r"\d+", defines["IMAGE_CHECK_HOURS"])]
+    return {
+        "check_hours": hours,
+        "min_battery": int(defines["MIN_BATTERY_PERCENT"]),
+        "preview_battery": int(defines["PREVIEW_ONLY_BATTERY_PERCENT"]),
+        "fetch_window": int(defines["FETCH_WINDOW_MINUTES"]),
+        "fetch_jitter": int(defines["FETCH_JITTER_SECONDS"]),
+        "full_refresh_ms": int(defines["FULL_REFRESH_MIN_INTERVAL"]),
+        "partial_refresh_max": int(defines["PARTIAL_REFRESH_MAX_COUNT"]),
+        "base_url": "",
+        "group": string("DEVICE_GROUP"),
+    }
+
+
+def hours_arg(value):
+    return [int(h) for h in value.split(",") if h.strip()]
+
+
+def wifi_arg(value):
+    ssid, _, password = value.partition(":")
+    return ssid, password
+
+
+def check(condition, message):
+    if not condition:
+        sys.exit("make_config.py: " + message)
+
+
+def main():
+    defaults = config_defaults()
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("--seq", type=int, help="config sequence (default: manifest config_seq + 1)")
+    parser.add_argument("--check-hours", type=hours_arg, help="e.g. 6,9,12,15,18,21,0")
+    parser.add_argument("--min-battery", type=int, help="minimum battery %% for updates")
+    parser.add_argument("--preview-battery", type=int, help="below this %%: layered preview only")
+    parser.add_argument("--fetch-window", type=int, help="check slot window (minutes, 0-60)")
+    parser.add_argument("--fetch-jitter", type=int, help="random delay per sleep (seconds)")
+    parser.add_argument("--full-refresh-ms", type=int, help="minimum interval between full refreshes")
+    parser.add_argument("--partial-refresh-max", type=int, help="partial refreshes before a full one")
+    parser.add_argument("--base-url", help="content server (default: CONTENT_BASE_URL of the firmware)")
+    parser.add_argument("--group", help="manifest group of the devices")
+    parser.add_argument("--wifi", type=wifi_arg, action="append", default=[],
+                        metavar="SSID:PASSWORD", help="extra network, tried before config.h (max 3)")
+    parser.add_argument("output", nargs="?", default=os.path.join("image", "config.bin"))
+    args = parser.parse_args()
+
+    values = {key: getattr(args, key) if getattr(args, key) is not None else value
+              for key, value in defaults.items()}
+    meta_path = os.path.join(os.path.dirname(args.output) or ".", "image_meta.json")
+    meta = {}
+    if os.path.exists(meta_path):
+        with open(meta_path) as f:
+            meta = json.load(f)
+    seq = args.seq if args.seq is not None else meta.get("config_seq", 0) + 1
+
+    check(seq > 0, "seq must be positive")
+    check(values["check_hours"] and all(0 <= h < 24 for h in values["check_hours"]),
+          "check hours must be 0-23")
+    check(0 <= values["min_battery"] <= 100 and 0 <= values["preview_battery"] <= 100,
+          "battery thresholds must be 0-100")
+    check(0 <= values["fetch_window"] <= 60, "fetch window must be 0-60 minutes")
+    check(0 <= values["fetch_jitter"] <= 3600, "fetch jitter must be 0-3600 seconds")
+    check(0 <= values["full_refresh_ms"] <= 600000, "full refresh interval must be 0-600000 ms")
+    check(1 <= values["partial_refresh_max"] <= 255, "partial refresh max must be 1-255")
+    check(not values["base_url"] or values["base_url"].startswith("http"),
+          "base URL must start with http")
+    check(len(values["base_url"]) < 128, "base URL must be shorter than 128 bytes")
+    check(len(values["group"]) < 32, "group must be shorter than 32 bytes")
+    check(len(args.wifi) <= WIFI_MAX, "at most %d networks" % WIFI_MAX)
+    check(all(0 < len(s) < 33 and len(p) < 65 for s, p in args.wifi),
+          "SSID 1-32 bytes, password up to 64 bytes")
+
+    wifi = []
+    for i in range(WIFI_MAX):
+        ssid, password = args.wifi[i] if i < len(args.wifi) else ("", "")
+        wifi += [ssid.encode(), password.encode()]
+
+    blob = struct.pack(
+        LAYOUT, b"MMCF", VERSION, SIZE, seq,
+        sum(1 << h for h in set(values["check_hours"])), values["full_refresh_ms"],
+        values["fetch_jitter"], values["min_battery"], values["preview_battery"],
+        values["fetch_window"], values["partial_refresh_max"], len(args.wifi), 0,
+        values["base_url"].rstrip("/").encode(), values["group"].encode(), *wifi)
+    blob += struct.pack("<I", zlib.crc32(blob))
+
+    with open(args.output, "wb") as f:
+        f.write(blob)
+
+    if meta:
+        meta["config_seq"] = seq
+        with open(meta_path, "w") as f:
+            json.dump(meta, f, indent=2)
+            f.write("\n")
+    print("%s: seq %d, %d bytes%s" % (args.output, seq, len(blob),
+                                     "" if meta else " (no image_meta.json: set config_seq by hand)"))
+
+
+if __name__ == "__main__":
+    main()
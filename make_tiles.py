@@ -0,0 +1,64 @@
+#!/usr/bin/env python3
+"""make_tiles.py - Pack JPEG tiles into an MMpaper tiled image (.mmt)
+
+Tiles are given in row-major order and laid out on a grid of TILE_WxTILE_H
+cells covering the panel (portrait 540x960). Used by update_image.sh --tiled.
+
+Layout (little-endian):
+    header   "MMTL" + tile count, width, height (uint16) + 6 reserved bytes
+    index    per tile: x, y, w, h (uint16) + offset, size (uint32) + MD5 (16 bytes)
+    data     the tile JPEGs, back to back
+
+The device compares the index with the one on flash and fetches only the
+tiles whose MD5 changed (HTTP Range), then refreshes only that area.
+"""
+
+import argparse
+import hashlib
+import struct
+import sys
+
+HEADER_SIZE = 16
+ENTRY_SIZE = 32
+MAX_TILES = 64
+
+
+def size_arg(value):
+    w, h = value.lower().split("x")
+    return int(w), int(h)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("--panel", type=size_arg, default=(540, 960), help="panel WxH")
+    parser.add_argument("--tile", type=size_arg, default=(135, 120), help="tile WxH")
+    parser.add_argument("output")
+    parser.add_argument("tiles", nargs="+")
+    args = parser.parse_args()
+
+    (panel_w, panel_h), (tile_w, tile_h) = args.panel, args.tile
+    columns = (panel_w + tile_w - 1) // tile_w
+    rows = (panel_h + tile_h - 1) // tile_h
+    if len(args.tiles) != columns * rows or len(args.tiles) > MAX_TILES:
+        sys.exit("expected %d tiles (max %d), got %d" % (columns * rows, MAX_TILES, len(args.tiles)))
+
+    tiles = []
+    for path in args.tiles:
+        with open(path, "rb") as f:
+            tiles.append(f.read())
+
+    index = b""
+    offset = HEADER_SIZE + ENTRY_SIZE * len(tiles)
+    for i, data in enumerate(tiles):
+        x, y = (i % columns) * tile_w, (i // columns) * tile_h
+        w, h = min(tile_w, panel_w - x), min(tile_h, panel_h - y)
+        index += struct.pack("<4H2I", x, y, w, h, offset, len(data)) + hashlib.md5(data).digest()
+        offset += len(data)
+
+    header = b"MMTL" + struct.pack("<3H6x", len(tiles), panel_w, panel_h)
+    with open(args.output, "wb") as f:
+        f.write(header + index + b"".join(tiles))
+
+
+if __name__ == "__main__":
+    main()
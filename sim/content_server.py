@@ -0,0 +1,255 @@
+#!/usr/bin/env python3
+"""content_server.py - Local stand-in for the MMpaper content server
+
+Serves files from --root (default: the repository) with scripted network
+behaviour, so the firmware can be exercised by the wake-cycle simulator
+without GitHub.
+
+Scenario file (JSON), all keys optional:
+
+    {
+      "latency_ms": 80,          # delay before the response headers (~1 RTT)
+      "bandwidth_kbps": 2000,    # body pacing
+      "loss": 0.02,              # per-segment chance of a retransmit stall
+      "rto_ms": 200,             # stall length for a lost segment
+      "drop": 0.0,               # chance to close the connection without replying
+      "truncate": 0.0,           # chance to cut the body in half and close
+      "chunked": false,          # Transfer-Encoding: chunked (HTTP/1.1 clients only: the firmware
+                                 # requests HTTP/1.0, so it never receives chunked bodies)
+      "encoding": "gzip",        # Content-Encoding if the client accepts it: gzip, deflate,
+                                 # deflate-raw (no zlib header) or none; never on Range requests
+      "status": null,            # force a status code (e.g. 304, 500)
+      "routes": {                # per-path overrides of any key above
+        "/image/current.jpg": {"encoding": "none"},
+        "/firmware.json": {"sequence": [{"status": 500}, {}]}
+      }
+    }
+
+A route "sequence" is applied to successive requests of that path (per
+device); the last entry repeats. ETag / If-None-Match is always honoured.
+"""
+
+import argparse
+import hashlib
+import json
+import os
+import random
+import re
+import sys
+import threading
+import time
+import zlib
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+SEGMENT = 1460
+
+
+class Scenario:
+    def __init__(self, path, seed):
+        self.config = {}
+        if path:
+            with open(path) as f:
+                self.config = json.load(f)
+        self.rng = random.Random(seed)
+        self.counters = {}
+        self.lock = threading.Lock()
+
+    def for_request(self, device, path):
+        """Merge global settings, route overrides and the sequence step."""
+        settings = {k: v for k, v in self.config.items() if k != "routes"}
+        route = self.config.get("routes", {}).get(path, {})
+        settings.update({k: v for k, v in route.items() if k != "sequence"})
+
+        sequence = route.get("sequence")
+        if sequence:
+            with self.lock:
+                n = self.counters.get((device, path), 0)
+                self.counters[(device, path)] = n + 1
+            settings.update(sequence[min(n, len(sequence) - 1)])
+        return settings
+
+    def chance(self, p):
+        with self.lock:
+            return p > 0 and self.rng.random() < p
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    server_version = "MMpaperSim/1.0"
+
+    encoding = None
+
+    def log_message(self, fmt, *args):
+        pass
+
+    def record(self, status, sent):
+        entry = {
+            "t": round(time.time(), 3),
+            "device": self.headers.get("X-Sim-Device", "?"),
+            "path": self.path,
+            "status": status,
+            "bytes": sent,
+        }
+        if self.encoding:
+            entry["encoding"] = self.encoding
+        with self.server.log_lock:
+            self.server.log.write(json.dumps(entry) + "\n")
+            self.server.log.flush()
+
+    def load(self, path):
+        if path == "/firmware.json" and self.server.firmware_version:
+            body = json.dumps({
+                "version": self.server.firmware_version,
+                "url": self.server.base_url + "/MMpaper.bin",
+            }).encode()
+            return body
+        full = os.path.realpath(os.path.join(self.server.root, path.lstrip("/")))
+        if not full.startswith(self.server.root + os.sep) or not os.path.isfile(full):
+            return None
+        with open(full, "rb") as f:
+            return f.read()
+
+    def send_paced(self, data, settings):
+        """Write body respecting bandwidth and simulated segment loss."""
+        kbps = settings.get("bandwidth_kbps", 0)
+        per_segment = (SEGMENT * 8.0 / (kbps * 1000.0)) if kbps else 0
+        sent = 0
+        for i in range(0, len(data), SEGMENT):
+            if self.server.scenario.chance(settings.get("loss", 0)):
+                time.sleep(settings.get("rto_ms", 200) / 1000.0)
+            if per_segment:
+                time.sleep(per_segment)
+            chunk = data[i:i + SEGMENT]
+            self.wfile.write(chunk)
+            sent += len(chunk)
+        return sent
+
+    def encode(self, body, encoding):
+        """Compress the body if the client accepts the scenario's encoding."""
+        accepted = [e.split(";")[0].strip()
+                    for e in self.headers.get("Accept-Encoding", "").split(",")]
+        name = encoding.replace("-raw", "")
+        if encoding == "none" or name not in accepted:
+            return body
+        self.encoding = encoding
+        if encoding == "gzip":
+            compressor = zlib.compressobj(9, zlib.DEFLATED, 31)
+        elif encoding == "deflate":
+            compressor = zlib.compressobj(9, zlib.DEFLATED, 15)
+        else:
+            compressor = zlib.compressobj(9, zlib.DEFLATED, -15)
+        return compressor.compress(body) + compressor.flush()
+
+    def do_GET(self):
+        path = self.path.split("?")[0]
+        device = self.headers.get("X-Sim-Device", "?")
+        settings = self.server.scenario.for_request(device, path)
+
+        time.sleep(settings.get("latency_ms", 0) / 1000.0)
+
+        if self.server.scenario.chance(settings.get("drop", 0)):
+            self.record("drop", 0)
+            self.close_connection = True
+            return
+
+        body = self.load(path)
+        status = settings.get("status") or (200 if body is not None else 404)
+        if body is None:
+            body = b""
+
+        headers = {"Connection": "close"}
+        etag = '"%s"' % hashlib.md5(body).hexdigest()
+        if status == 200:
+            headers["ETag"] = etag
+            if self.headers.get("If-None-Match") == etag:
+                status = 304
+
+        if status == 200:
+            match = re.match(r"bytes=(\d+)-(\d*)$", self.headers.get("Range", ""))
+            if match and body:
+                start = int(match.group(1))
+                end = int(match.group(2)) if match.group(2) else len(body) - 1
+                if start >= len(body):
+                    headers["Content-Range"] = "bytes */%d" % len(body)
+                    status, body = 416, b""
+                else:
+                    end = min(end, len(body) - 1)
+                    headers["Content-Range"] = "bytes %d-%d/%d" % (start, end, len(body))
+                    status, body = 206, body[start:end + 1]
+
+        if status not in (200, 206):
+            body = b""
+
+        self.encoding = None
+        if status == 200 and body:
+            body = self.encode(body, settings.get("encoding", "gzip"))
+            if self.encoding:
+                headers["Content-Encoding"] = self.encoding.replace("-raw", "")
+
+        truncated = status in (200, 206) and self.server.scenario.chance(settings.get("truncate", 0))
+        chunked = (settings.get("chunked", False) and status in (200, 206)
+                   and self.request_version != "HTTP/1.0")
+
+        self.send_response(status)
+        for name, value in headers.items():
+            self.send_header(name, value)
+        if chunked:
+            self.send_header("Transfer-Encoding", "chunked")
+        else:
+            self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+
+        payload = body[:len(body) // 2] if truncated else body
+        sent = 0
+        if chunked:
+            for i in range(0, len(payload), 4096):
+                piece = payload[i:i + 4096]
+                self.wfile.write(b"%x\r\n" % len(piece))
+                sent += self.send_paced(piece, settings)
+                self.wfile.write(b"\r\n")
+            if not truncated:
+                self.wfile.write(b"0\r\n\r\n")
+        else:
+            sent = self.send_paced(payload, settings)
+
+        self.record("%d%s" % (status, " truncated" if truncated else ""), sent)
+        self.close_connection = True
+
+
+class Server(ThreadingHTTPServer):
+    daemon_threads = True
+
+    def handle_error(self, request, client_address):
+        # The device may hang up mid-body (timeout, aborted download)
+        if not isinstance(sys.exc_info()[1], (ConnectionResetError, BrokenPipeError)):
+            super().handle_error(request, client_address)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("--root", default=os.path.join(os.path.dirname(__file__), ".."))
+    parser.add_argument("--port", type=int, default=8080)
+    parser.add_argument("--scenario", help="scenario JSON file")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--firmware-version",
+                        help="serve a synthetic firmware.json with this version")
+    parser.add_argument("--log", default="-", help="request log (JSON lines)")
+    args = parser.parse_args()
+
+    server = Server(("127.0.0.1", args.port), Handler)
+    server.root = os.path.realpath(args.root)
+    server.scenario = Scenario(args.scenario, args.seed)
+    server.firmware_version = args.firmware_version
+    server.base_url = "http://127.0.0.1:%d" % server.server_address[1]
+    server.log = sys.stdout if args.log == "-" else open(args.log, "a")
+    server.log_lock = threading.Lock()
+
+    print("Serving %s on %s" % (server.root, server.base_url), file=sys.stderr, flush=True)
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,163 @@
+#!/usr/bin/env python3
+"""run_fleet.py - Run the MMpaper wake-cycle simulator for a fleet of devices
+
+Builds sim/build/mmpaper_sim, starts content_server.py on a free port and
+runs every device through N wakes (each wake is one process: setup() until
+deep sleep or restart, with NVS/RTC/SD state kept in <out>/<device>/).
+Devices run in parallel so their requests overlap on the server.
+
+Writes <out>/wakes.jsonl (one report per wake) and <out>/server.jsonl
+(one line per HTTP request), then prints a summary.
+"""
+
+import argparse
+import collections
+import json
+import os
+import re
+import shutil
+import socket
+import subprocess
+import sys
+import time
+from concurrent.futures import ThreadPoolExecutor
+
+SIM_DIR = os.path.dirname(os.path.abspath(__file__))
+REPO_DIR = os.path.dirname(SIM_DIR)
+BINARY = os.path.join(SIM_DIR, "build", "mmpaper_sim")
+
+
+def firmware_version():
+    with open(os.path.join(REPO_DIR, "include", "config.h")) as f:
+        match = re.search(r'#define FIRMWARE_VERSION "([^"]+)"', f.read())
+    return match.group(1) if match else None
+
+
+def free_port():
+    with socket.socket() as s:
+        s.bind(("127.0.0.1", 0))
+        return s.getsockname()[1]
+
+
+def run_device(index, args, base_url):
+    device = "dev%03d" % index
+    state = os.path.join(args.out, device)
+    os.makedirs(state, exist_ok=True)
+    if args.sd_seed:
+        shutil.copytree(args.sd_seed, os.path.join(state, "sd", "mmpaper"), dirs_exist_ok=True)
+
+    reports = []
+    for wake in range(args.wakes):
+        cmd = [BINARY, "--state", state, "--device", device, "--base-url", base_url,
+               "--battery", str(args.battery), "--mac", "24587c%06x" % (0xA00000 + index),
+               "--start-epoch", str(args.start_epoch)]
+        if args.sd or args.sd_seed:
+            cmd.append("--sd")
+        if args.no_ap:
+            cmd.append("--no-ap")
+        if args.button_every and wake > 0 and wake % args.button_every == 0:
+            cmd += ["--button", "A"]
+        if args.tickless_idle:
+            cmd.append("--tickless-idle")
+        if args.verbose:
+            cmd.append("--verbose")
+
+        out = subprocess.run(cmd, stdout=subprocess.PIPE, check=True, text=True).stdout
+        reports.append(json.loads(out.strip().splitlines()[-1]))
+    return reports
+
+
+def summarize(reports, server_log):
+    n = len(reports)
+    if n == 0:
+        return
+    total = lambda key: sum(r[key] for r in reports)
+    mean = lambda key: total(key) / n
+
+    print("Wakes: %d  (%s)" % (n, ", ".join(
+        "%s=%d" % kv for kv in sorted(collections.Counter(r["end"] for r in reports).items()))))
+    print("Per wake (mean): awake %.0f ms, cpu active %.0f ms, radio %.0f ms, "
+          "%.1f refreshes" % (mean("awake_ms"), mean("cpu_active_ms"), mean("radio_ms"),
+                              mean("refreshes")))
+    print("Per wake (mean): %.1f KB rx, %.1f KB tx, %.1f requests, %.1f round trips" % (
+        mean("bytes_rx") / 1024, mean("bytes_tx") / 1024, mean("requests"), mean("round_trips")))
+    print("Energy: awake %.3f mAh + sleep %.3f mAh per wake, fleet total %.1f mAh" % (
+        mean("energy_awake_mah"), mean("energy_sleep_mah"),
+        total("energy_awake_mah") + total("energy_sleep_mah")))
+
+    # Server load by minute-of-hour (UTC) of the wake
+    by_minute = collections.Counter()
+    for r in reports:
+        if r["requests"]:
+            by_minute[(r["epoch"] // 60) % 60] += r["requests"]
+    if by_minute:
+        peak = max(by_minute.values())
+        print("Server load by minute of hour: peak %d requests at :%02d, %d distinct minutes" % (
+            peak, max(by_minute, key=by_minute.get), len(by_minute)))
+
+    statuses = collections.Counter(entry["status"] for entry in server_log)
+    print("Server responses: %s" % ", ".join("%s=%d" % kv for kv in sorted(statuses.items())))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("--devices", type=int, default=4)
+    parser.add_argument("--wakes", type=int, default=8)
+    parser.add_argument("--scenario", help="content_server.py scenario JSON")
+    parser.add_argument("--root", default=REPO_DIR, help="content root served to devices")
+    parser.add_argument("--out", default=os.path.join(SIM_DIR, "state"))
+    parser.add_argument("--battery", type=int, default=100)
+    parser.add_argument("--start-epoch", type=int, default=1767261600)
+    parser.add_argument("--sd", action="store_true", help="devices have a microSD card")
+    parser.add_argument("--sd-seed", help="directory copied to /mmpaper on every card")
+    parser.add_argument("--no-ap", action="store_true", help="no WiFi in range")
+    parser.add_argument("--button-every", type=int, default=0,
+                        help="every Nth wake is a button press")
+    parser.add_argument("--keep-firmware-json", action="store_true",
+                        help="serve the real firmware.json (default: current version, no OTA)")
+    parser.add_argument("--tickless-idle", action="store_true",
+                        help="core built with tickless idle (default: stock Arduino, DFS only)")
+    parser.add_argument("--verbose", action="store_true")
+    args = parser.parse_args()
+
+    subprocess.run(["make", "-s", "-C", SIM_DIR], check=True)
+    shutil.rmtree(args.out, ignore_errors=True)
+    os.makedirs(args.out)
+
+    port = free_port()
+    server_log = os.path.join(args.out, "server.jsonl")
+    cmd = [sys.executable, os.path.join(SIM_DIR, "content_server.py"), "--root", args.root,
+           "--port", str(port), "--log", server_log]
+    if args.scenario:
+        cmd += ["--scenario", args.scenario]
+    if not args.keep_firmware_json:
+        cmd += ["--firmware-version", firmware_version()]
+    server = subprocess.Popen(cmd)
+
+    try:
+        for _ in range(50):
+            try:
+                socket.create_connection(("127.0.0.1", port), timeout=0.1).close()
+                break
+            except OSError:
+                time.sleep(0.1)
+
+        base_url = "http://127.0.0.1:%d" % port
+        with ThreadPoolExecutor(max_workers=min(args.devices, 32)) as pool:
+            results = pool.map(lambda i: run_device(i, args, base_url), range(args.devices))
+            reports = [r for device in results for r in device]
+    finally:
+        server.terminate()
+        server.wait()
+
+    with open(os.path.join(args.out, "wakes.jsonl"), "w") as f:
+        for r in reports:
+            f.write(json.dumps(r) + "\n")
+    with open(server_log) as f:
+        log = [json.loads(line) for line in f if line.strip()]
+
+    summarize(reports, log)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,182 @@
+// Host shim: core Arduino-ESP32 per il simulatore di wake-cycle
+// Solo ciò che usa src/main.cpp; tempo e consumi passano per sim_runtime.cpp
+#pragma once
+
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <algorithm>
+
+#include "WString.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+
+using std::max;
+using std::min;
+
+#define BIT0 0x00000001
+#define BIT1 0x00000002
+#define BIT2 0x00000004
+#define BIT3 0x00000008
+#define BIT4 0x00000010
+#define BIT5 0x00000020
+#define BIT6 0x00000040
+#define BIT7 0x00000080
+
+// RTC memory: sezione propria, salvata/ripristinata dal runtime tra un wake e l'altro
+#define RTC_DATA_ATTR __attribute__((section("rtc_data")))
+#define IRAM_ATTR
+
+// ===== SIMULATOR HOOKS =====
+namespace sim {
+uint64_t nowMs();                  // Clock virtuale dall'inizio del wake
+void advanceMs(uint64_t ms);       // Attesa simulata (nessuna attesa reale)
+const char* contentBaseURL();
+}  // namespace sim
+
+#define CONTENT_BASE_URL sim::contentBaseURL()
+
+// ===== TIMING =====
+inline unsigned long millis() { return (unsigned long)sim::nowMs(); }
+inline unsigned long micros() { return (unsigned long)(sim::nowMs() * 1000); }
+inline void delay(uint32_t ms) { sim::advanceMs(ms); }
+inline void yield() {}
+
+// ===== GPIO =====
+// Pulsanti: sempre rilasciati (il wake da pulsante arriva da --button)
+#define LOW 0
+#define HIGH 1
+#define INPUT 0x01
+#define INPUT_PULLUP 0x05
+inline void pinMode(uint8_t, uint8_t) {}
+inline int digitalRead(uint8_t) { return HIGH; }
+
+enum gpio_num_t : int { GPIO_NUM_NC = -1 };
+
+bool getLocalTime(struct tm* info, uint32_t ms = 5000);
+void configTime(long gmtOffsetSec, int daylightOffsetSec, const char* server1,
+                const char* server2 = nullptr, const char* server3 = nullptr);
+
+// ===== STREAM / PRINT =====
+class Print {
+ public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buf, size_t size) {
+    size_t n = 0;
+    while (size--) n += write(*buf++);
+    return n;
+  }
+  size_t print(const String& s) { return write((const uint8_t*)s.c_str(), s.length()); }
+  size_t print(const char* s) { return write((const uint8_t*)s, strlen(s)); }
+  size_t println(const String& s = String()) { return print(s) + print("\n"); }
+  size_t printf(const char* fmt, ...) __attribute__((format(printf, 2, 3))) {
+    char buf[1024];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    if (len < 0) return 0;
+    return write((const uint8_t*)buf, std::min<size_t>(len, sizeof(buf) - 1));
+  }
+};
+
+class Stream : public Print {
+ public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() { return -1; }
+  virtual void flush() {}
+  void setTimeout(unsigned long ms) { timeout_ = ms; }
+  size_t readBytes(uint8_t* buf, size_t len) {
+    size_t n = 0;
+    while (n < len) {
+      int c = read();
+      if (c < 0) break;
+      buf[n++] = (uint8_t)c;
+    }
+    return n;
+  }
+  String readString() {
+    std::string s;
+    for (int c = read(); c >= 0; c = read()) s += (char)c;
+    return String(s);
+  }
+  String readStringUntil(char term) {
+    std::string s;
+    for (int c = read(); c >= 0 && c != term; c = read()) s += (char)c;
+    return String(s);
+  }
+
+ protected:
+  unsigned long timeout_ = 1000;
+};
+
+class HardwareSerial : public Stream {
+ public:
+  void begin(unsigned long) {}
+  void end() {}
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t* buf, size_t size) override;
+  int available() override { return 0; }
+  int read() override { return -1; }
+  operator bool() const { return true; }
+};
+extern HardwareSerial Serial;
+
+// ===== ESP =====
+class EspClass {
+ public:
+  [[noreturn]] void restart();
+  uint64_t getEfuseMac();
+  uint32_t getFreeHeap() { return 256 * 1024; }
+  uint32_t getFreePsram() { return 8 * 1024 * 1024; }
+};
+extern EspClass ESP;
+
+#define MALLOC_CAP_DMA (1 << 3)
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+inline void* heap_caps_malloc(size_t size, uint32_t) { return malloc(size); }
+inline void heap_caps_free(void* p) { free(p); }
+inline void* ps_malloc(size_t size) { return malloc(size); }
+
+uint32_t esp_random();
+
+// newlib (ESP32) ha strlcpy, glibc < 2.38 no
+#if !defined(__GLIBC__) || __GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 38)
+inline size_t strlcpy(char* dst, const char* src, size_t size) {
+  size_t len = strlen(src);
+  if (size > 0) {
+    size_t n = len < size - 1 ? len : size - 1;
+    memcpy(dst, src, n);
+    dst[n] = '\0';
+  }
+  return len;
+}
+#endif
+
+// ===== SLEEP =====
+typedef enum {
+  ESP_SLEEP_WAKEUP_UNDEFINED = 0,
+  ESP_SLEEP_WAKEUP_ALL,
+  ESP_SLEEP_WAKEUP_EXT0,
+  ESP_SLEEP_WAKEUP_EXT1,
+  ESP_SLEEP_WAKEUP_TIMER,
+} esp_sleep_wakeup_cause_t;
+
+typedef enum {
+  ESP_EXT1_WAKEUP_ALL_LOW = 0,
+  ESP_EXT1_WAKEUP_ANY_HIGH = 1,
+} esp_sleep_ext1_wakeup_mode_t;
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t timeUs);
+esp_err_t esp_sleep_enable_ext0_wakeup(gpio_num_t pin, int level);
+esp_err_t esp_sleep_enable_ext1_wakeup(uint64_t mask, esp_sleep_ext1_wakeup_mode_t mode);
+uint64_t esp_sleep_get_ext1_wakeup_status();
+[[noreturn]] void esp_deep_sleep_start();
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause();
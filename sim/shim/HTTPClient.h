@@ -0,0 +1,63 @@
+// Host shim: HTTPClient con la stessa semantica di quello Arduino-ESP32
+// - getSize() = -1 se la risposta è chunked o senza Content-Length
+// - getStreamPtr() restituisce lo stream grezzo (framing chunked incluso)
+// - getString() decodifica chunked / Content-Length / fino a chiusura
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "WiFi.h"
+
+#define HTTPC_ERROR_CONNECTION_REFUSED (-1)
+#define HTTPC_ERROR_SEND_HEADER_FAILED (-2)
+#define HTTPC_ERROR_NOT_CONNECTED (-4)
+#define HTTPC_ERROR_CONNECTION_LOST (-5)
+#define HTTPC_ERROR_NO_HTTP_SERVER (-7)
+#define HTTPC_ERROR_READ_TIMEOUT (-11)
+
+typedef enum {
+  HTTP_CODE_OK = 200,
+  HTTP_CODE_PARTIAL_CONTENT = 206,
+  HTTP_CODE_NOT_MODIFIED = 304,
+  HTTP_CODE_NOT_FOUND = 404,
+  HTTP_CODE_RANGE_NOT_SATISFIABLE = 416,
+} t_http_codes;
+
+class HTTPClient {
+ public:
+  ~HTTPClient() { end(); }
+
+  bool begin(WiFiClient& client, const String& url);
+  void end();
+  int GET();
+  int getSize() const { return size_; }
+  String getString();
+  WiFiClient* getStreamPtr() { return client_; }
+  WiFiClient& getStream() { return *client_; }
+  bool connected() { return client_ != nullptr && client_->connected(); }
+
+  void addHeader(const String& name, const String& value);
+  void collectHeaders(const char* keys[], const size_t count);
+  String header(const char* name);
+  bool hasHeader(const char* name);
+  void useHTTP10(bool use) { http10_ = use; }
+  void setReuse(bool reuse) { reuse_ = reuse; }
+  void setTimeout(uint16_t ms) { timeout_ = ms; }
+  static String errorToString(int error);
+
+ private:
+  WiFiClient* client_ = nullptr;
+  std::string host_;
+  std::string path_;
+  uint16_t port_ = 80;
+  bool http10_ = false;
+  bool reuse_ = true;
+  bool chunked_ = false;
+  uint16_t timeout_ = 5000;
+  int size_ = -1;
+  std::string extraHeaders_;
+  std::vector<std::string> wantedHeaders_;
+  std::map<std::string, std::string> headers_;
+};
@@ -0,0 +1,97 @@
+// Host shim: M5Unified (display e-ink, power, pulsanti)
+// Ogni refresh avanza il clock virtuale e finisce nel modello energetico
+#pragma once
+
+#include "Arduino.h"
+#include "lgfx/utility/lgfx_tjpgd.h"
+
+#define TFT_BLACK 0x0000
+#define TFT_WHITE 0xFFFF
+
+namespace fonts {
+struct GFXfont {
+  int id;
+};
+extern const GFXfont FreeSans18pt7b;
+extern const GFXfont FreeSans12pt7b;
+extern const GFXfont Font0;
+}  // namespace fonts
+
+typedef enum { top_left, top_center, top_right, middle_left, middle_center, middle_right,
+               bottom_left, bottom_center, bottom_right } textdatum_t;
+
+typedef enum { epd_quality = 1, epd_text = 2, epd_fast = 3, epd_fastest = 4 } epd_mode_t;
+
+class M5GFX {
+ public:
+  void setRotation(uint8_t r) { rotation_ = r; }
+  int32_t width() const { return (rotation_ & 1) ? 540 : 960; }
+  int32_t height() const { return (rotation_ & 1) ? 960 : 540; }
+  void setFont(const fonts::GFXfont*) {}
+  void setTextDatum(textdatum_t) {}
+  void setTextColor(uint32_t, uint32_t = 0) {}
+  void setTextSize(float) {}
+  void setColorDepth(int) {}
+  void setEpdMode(epd_mode_t mode) { mode_ = mode; }
+  epd_mode_t getEpdMode() const { return mode_; }
+  void setAutoDisplay(bool) {}
+  void fillScreen(uint32_t) { dirty_ = true; }
+  void fillRect(int32_t, int32_t, int32_t, int32_t, uint32_t) { dirty_ = true; }
+  void drawString(const char*, int32_t, int32_t) { dirty_ = true; }
+  void drawString(const String& s, int32_t x, int32_t y) { drawString(s.c_str(), x, y); }
+  bool drawJpg(const uint8_t* data, uint32_t len, int32_t x = 0, int32_t y = 0,
+               int32_t maxWidth = 0, int32_t maxHeight = 0, int32_t offX = 0,
+               int32_t offY = 0, float scaleX = 1.0f, float scaleY = 0.0f);
+  void display();
+  void display(int32_t x, int32_t y, int32_t w, int32_t h);
+  void waitDisplay() {}
+  void sleep() {}
+  void wakeup() {}
+
+ private:
+  uint8_t rotation_ = 0;
+  epd_mode_t mode_ = epd_quality;
+  bool dirty_ = false;
+};
+
+namespace m5 {
+struct config_t {
+  bool serial_baudrate = true;
+  bool internal_imu = true;
+  bool internal_rtc = true;
+  bool clear_display = true;
+};
+
+class Power_Class {
+ public:
+  int32_t getBatteryLevel();
+  int16_t getBatteryVoltage() { return 3700 + getBatteryLevel() * 5; }
+};
+
+class Button_Class {
+ public:
+  bool isPressed() const { return pressed_; }
+  bool wasPressed() const { return pressed_; }
+  bool wasClicked() const { return pressed_; }
+  void setPressed(bool p) { pressed_ = p; }
+
+ private:
+  bool pressed_ = false;
+};
+
+class M5Unified {
+ public:
+  config_t config() const { return config_t(); }
+  void begin(const config_t& cfg);
+  void update() {}
+
+  M5GFX Display;
+  Power_Class Power;
+  Button_Class BtnA;
+  Button_Class BtnB;
+  Button_Class BtnC;
+  Button_Class BtnPWR;
+};
+}  // namespace m5
+
+extern m5::M5Unified M5;
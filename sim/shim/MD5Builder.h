@@ -0,0 +1,24 @@
+// Host shim: MD5Builder (RFC 1321)
+#pragma once
+
+#include "Arduino.h"
+
+class MD5Builder {
+ public:
+  void begin();
+  void add(const uint8_t* data, size_t len);
+  void add(const char* data) { add((const uint8_t*)data, strlen(data)); }
+  void add(const String& data) { add((const uint8_t*)data.c_str(), data.length()); }
+  void calculate();
+  void getBytes(uint8_t* output) const { memcpy(output, digest_, 16); }
+  void getChars(char* output) const;
+  String toString() const;
+
+ private:
+  void transform(const uint8_t block[64]);
+
+  uint32_t state_[4];
+  uint64_t count_ = 0;
+  uint8_t buffer_[64];
+  uint8_t digest_[16];
+};
@@ -0,0 +1,33 @@
+// Host shim: NVS persistita su file nella cartella di stato del device
+#pragma once
+
+#include "Arduino.h"
+
+class Preferences {
+ public:
+  bool begin(const char* name, bool readOnly = false);
+  void end();
+  bool clear();
+  bool remove(const char* key);
+  bool isKey(const char* key);
+
+  size_t putInt(const char* key, int32_t value);
+  size_t putUInt(const char* key, uint32_t value);
+  size_t putULong(const char* key, uint32_t value) { return putUInt(key, value); }
+  size_t putBool(const char* key, bool value) { return putUInt(key, value ? 1 : 0); }
+  size_t putString(const char* key, const String& value);
+  size_t putBytes(const char* key, const void* value, size_t len);
+
+  int32_t getInt(const char* key, int32_t defaultValue = 0);
+  uint32_t getUInt(const char* key, uint32_t defaultValue = 0);
+  uint32_t getULong(const char* key, uint32_t defaultValue = 0) { return getUInt(key, defaultValue); }
+  bool getBool(const char* key, bool defaultValue = false) { return getUInt(key, defaultValue) != 0; }
+  String getString(const char* key, const String& defaultValue = String());
+  size_t getBytesLength(const char* key);
+  size_t getBytes(const char* key, void* buf, size_t maxLen);
+
+ private:
+  std::string ns_;
+  bool readOnly_ = true;
+  bool open_ = false;
+};
@@ -0,0 +1,59 @@
+// Host shim: microSD mappata sulla cartella <state>/sd (--sd per inserirla)
+#pragma once
+
+#include <memory>
+
+#include "Arduino.h"
+#include "SPI.h"
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+struct SimFileImpl;
+
+class File : public Stream {
+ public:
+  File() {}
+  explicit File(std::shared_ptr<SimFileImpl> impl) : impl_(impl) {}
+
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* buf, size_t size) override;
+  int available() override;
+  int read() override;
+  size_t read(uint8_t* buf, size_t size);
+  int peek() override;
+  bool seek(uint32_t pos);
+  size_t position() const;
+  size_t size() const;
+  const char* name() const;
+  const char* path() const;
+  bool isDirectory() const;
+  File openNextFile(const char* mode = FILE_READ);
+  void close();
+  operator bool() const;
+
+ private:
+  std::shared_ptr<SimFileImpl> impl_;
+};
+
+class SDFS {
+ public:
+  bool begin(uint8_t ssPin, SPIClass& spi, uint32_t frequency = 4000000,
+             const char* mountpoint = "/sd", uint8_t maxFiles = 5);
+  void end() { mounted_ = false; }
+  File open(const char* path, const char* mode = FILE_READ);
+  File open(const String& path, const char* mode = FILE_READ) { return open(path.c_str(), mode); }
+  bool exists(const char* path);
+  bool exists(const String& path) { return exists(path.c_str()); }
+  bool mkdir(const char* path);
+  bool remove(const char* path);
+  bool remove(const String& path) { return remove(path.c_str()); }
+  bool rename(const char* from, const char* to);
+  uint64_t totalBytes() { return 16ULL << 30; }
+  uint64_t usedBytes() { return 0; }
+
+ private:
+  bool mounted_ = false;
+};
+extern SDFS SD;
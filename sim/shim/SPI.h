@@ -0,0 +1,11 @@
+// Host shim: bus SPI (nessun effetto)
+#pragma once
+
+#include <cstdint>
+
+class SPIClass {
+ public:
+  void begin(int8_t sck = -1, int8_t miso = -1, int8_t mosi = -1, int8_t ss = -1) {}
+  void end() {}
+};
+extern SPIClass SPI;
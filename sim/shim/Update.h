@@ -0,0 +1,24 @@
+// Host shim: OTA (conta solo i byte, nessuna scrittura)
+#pragma once
+
+#include "Arduino.h"
+
+#define UPDATE_SIZE_UNKNOWN 0xFFFFFFFF
+
+class UpdateClass {
+ public:
+  bool begin(size_t size = UPDATE_SIZE_UNKNOWN);
+  size_t write(uint8_t* data, size_t len);
+  bool end(bool evenIfRemaining = false);
+  void abort() { active_ = false; }
+  bool isFinished() const { return finished_; }
+  const char* errorString() const { return error_; }
+
+ private:
+  size_t size_ = 0;
+  size_t written_ = 0;
+  bool active_ = false;
+  bool finished_ = false;
+  const char* error_ = "No Error";
+};
+extern UpdateClass Update;
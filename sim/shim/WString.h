@@ -0,0 +1,104 @@
+// Host shim: sottoinsieme di Arduino String usato dal firmware
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+class String {
+ public:
+  String() {}
+  String(const char* s) : s_(s ? s : "") {}
+  String(const std::string& s) : s_(s) {}
+  String(char c) : s_(1, c) {}
+  String(int v) : s_(std::to_string(v)) {}
+  String(unsigned int v) : s_(std::to_string(v)) {}
+  String(long v) : s_(std::to_string(v)) {}
+  String(unsigned long v) : s_(std::to_string(v)) {}
+  String(long long v) : s_(std::to_string(v)) {}
+  String(unsigned long long v) : s_(std::to_string(v)) {}
+
+  const char* c_str() const { return s_.c_str(); }
+  unsigned int length() const { return s_.size(); }
+  bool isEmpty() const { return s_.empty(); }
+  const std::string& str() const { return s_; }
+
+  char charAt(unsigned int i) const { return i < s_.size() ? s_[i] : 0; }
+  char operator[](unsigned int i) const { return charAt(i); }
+
+  int indexOf(char c, unsigned int from = 0) const { return find(s_.find(c, from)); }
+  int indexOf(const String& t, unsigned int from = 0) const { return find(s_.find(t.s_, from)); }
+  int indexOf(const char* t, unsigned int from = 0) const { return find(s_.find(t, from)); }
+  int lastIndexOf(char c) const { return find(s_.rfind(c)); }
+  int lastIndexOf(char c, unsigned int from) const { return find(s_.rfind(c, from)); }
+  int lastIndexOf(const String& t) const { return find(s_.rfind(t.s_)); }
+
+  String substring(unsigned int from) const {
+    return from >= s_.size() ? String() : String(s_.substr(from));
+  }
+  String substring(unsigned int from, unsigned int to) const {
+    if (from > to) std::swap(from, to);
+    if (from >= s_.size()) return String();
+    return String(s_.substr(from, std::min<size_t>(to, s_.size()) - from));
+  }
+
+  bool startsWith(const String& p) const { return s_.compare(0, p.s_.size(), p.s_) == 0; }
+  bool endsWith(const String& p) const {
+    return s_.size() >= p.s_.size() &&
+           s_.compare(s_.size() - p.s_.size(), p.s_.size(), p.s_) == 0;
+  }
+  bool equals(const String& o) const { return s_ == o.s_; }
+  bool equalsIgnoreCase(const String& o) const {
+    if (s_.size() != o.s_.size()) return false;
+    for (size_t i = 0; i < s_.size(); i++) {
+      if (tolower((unsigned char)s_[i]) != tolower((unsigned char)o.s_[i])) return false;
+    }
+    return true;
+  }
+
+  void toLowerCase() {
+    for (auto& c : s_) c = tolower((unsigned char)c);
+  }
+  void toUpperCase() {
+    for (auto& c : s_) c = toupper((unsigned char)c);
+  }
+  void trim() {
+    size_t b = s_.find_first_not_of(" \t\r\n");
+    size_t e = s_.find_last_not_of(" \t\r\n");
+    s_ = (b == std::string::npos) ? "" : s_.substr(b, e - b + 1);
+  }
+  void replace(const String& from, const String& to) {
+    if (from.s_.empty()) return;
+    for (size_t p = s_.find(from.s_); p != std::string::npos; p = s_.find(from.s_, p + to.s_.size())) {
+      s_.replace(p, from.s_.size(), to.s_);
+    }
+  }
+  void remove(unsigned int index, unsigned int count = (unsigned int)-1) {
+    if (index < s_.size()) s_.erase(index, count);
+  }
+
+  long toInt() const { return strtol(s_.c_str(), nullptr, 10); }
+  float toFloat() const { return strtof(s_.c_str(), nullptr); }
+
+  bool concat(const String& o) { s_ += o.s_; return true; }
+  String& operator+=(const String& o) { s_ += o.s_; return *this; }
+  String& operator+=(const char* o) { s_ += o; return *this; }
+  String& operator+=(char c) { s_ += c; return *this; }
+
+  bool operator==(const String& o) const { return s_ == o.s_; }
+  bool operator!=(const String& o) const { return s_ != o.s_; }
+  bool operator==(const char* o) const { return s_ == o; }
+  bool operator!=(const char* o) const { return s_ != o; }
+  bool operator<(const String& o) const { return s_ < o.s_; }
+
+  friend String operator+(const String& a, const String& b) { return String(a.s_ + b.s_); }
+  friend String operator+(const String& a, const char* b) { return String(a.s_ + b); }
+  friend String operator+(const char* a, const String& b) { return String(a + b.s_); }
+  friend String operator+(const String& a, char b) { return String(a.s_ + b); }
+
+ private:
+  static int find(size_t p) { return p == std::string::npos ? -1 : (int)p; }
+  std::string s_;
+};
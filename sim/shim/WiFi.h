@@ -0,0 +1,105 @@
+// Host shim: WiFi station + client TCP su socket POSIX
+// Le reti raggiungibili si scelgono da riga di comando (--ap / --no-ap)
+#pragma once
+
+#include "Arduino.h"
+#include "esp_err.h"
+
+typedef enum {
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_DISCONNECTED = 6,
+} wl_status_t;
+
+typedef enum { WIFI_OFF = 0, WIFI_STA = 1, WIFI_AP = 2, WIFI_AP_STA = 3 } wifi_mode_t;
+typedef enum { WIFI_PS_NONE, WIFI_PS_MIN_MODEM, WIFI_PS_MAX_MODEM } wifi_ps_type_t;
+
+typedef enum {
+  ARDUINO_EVENT_WIFI_STA_START,
+  ARDUINO_EVENT_WIFI_STA_CONNECTED,
+  ARDUINO_EVENT_WIFI_STA_DISCONNECTED,
+  ARDUINO_EVENT_WIFI_STA_GOT_IP,
+} arduino_event_id_t;
+
+#define WIFI_REASON_AUTH_FAIL 202
+#define WIFI_REASON_NO_AP_FOUND 201
+#define WIFI_REASON_ASSOC_LEAVE 8
+
+typedef struct {
+  uint8_t reason;
+} wifi_event_sta_disconnected_t;
+
+typedef union {
+  wifi_event_sta_disconnected_t wifi_sta_disconnected;
+} arduino_event_info_t;
+
+typedef arduino_event_id_t WiFiEvent_t;
+typedef arduino_event_info_t WiFiEventInfo_t;
+typedef void (*WiFiEventFuncCb)(WiFiEvent_t event, WiFiEventInfo_t info);
+
+class IPAddress {
+ public:
+  String toString() const { return String("192.168.1.77"); }
+};
+
+class WiFiClass {
+ public:
+  bool mode(wifi_mode_t m);
+  wifi_mode_t getMode() const { return mode_; }
+  wl_status_t begin(const char* ssid, const char* password = nullptr);
+  bool disconnect(bool wifiOff = false);
+  wl_status_t status() const { return status_; }
+  bool isConnected() const { return status_ == WL_CONNECTED; }
+  IPAddress localIP() const { return IPAddress(); }
+  int8_t RSSI() const { return -58; }
+  String macAddress() const;
+  bool setSleep(bool enabled) { return setSleep(enabled ? WIFI_PS_MIN_MODEM : WIFI_PS_NONE); }
+  bool setSleep(wifi_ps_type_t type) { ps_ = type; return true; }
+  wifi_ps_type_t getSleep() const { return ps_; }
+  int onEvent(WiFiEventFuncCb cb);
+
+ private:
+  unsigned generation_ = 0;  // Invalida eventi di tentativi precedenti
+  void dispatch(WiFiEvent_t event, uint8_t reason = 0);
+
+  wifi_mode_t mode_ = WIFI_OFF;
+  wl_status_t status_ = WL_IDLE_STATUS;
+  wifi_ps_type_t ps_ = WIFI_PS_MIN_MODEM;
+  WiFiEventFuncCb callbacks_[8] = {};
+  int numCallbacks_ = 0;
+};
+extern WiFiClass WiFi;
+
+class WiFiClient : public Stream {
+ public:
+  WiFiClient() {}
+  virtual ~WiFiClient() { stop(); }
+  WiFiClient(const WiFiClient&) = delete;
+  WiFiClient& operator=(const WiFiClient&) = delete;
+
+  int connect(const char* host, uint16_t port);
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* buf, size_t size) override;
+  int available() override;
+  int read() override;
+  int read(uint8_t* buf, size_t size);
+  int peek() override;
+  uint8_t connected();
+  void stop();
+  int fd() const { return fd_; }
+  operator bool() { return connected(); }
+
+  // Solo simulatore: lettura bloccante con timeout (usata da HTTPClient)
+  int readTimeout(uint32_t timeoutMs);
+
+ private:
+  bool fill(bool block);
+
+  int fd_ = -1;
+  bool eof_ = false;
+  uint8_t buf_[4096];
+  size_t bufPos_ = 0;
+  size_t bufLen_ = 0;
+};
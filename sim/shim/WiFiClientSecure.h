@@ -0,0 +1,10 @@
+// Host shim: nel simulatore il "TLS" è TCP in chiaro verso il server locale
+#pragma once
+
+#include "WiFi.h"
+
+class WiFiClientSecure : public WiFiClient {
+ public:
+  void setInsecure() {}
+  void setCACert(const char*) {}
+};
@@ -0,0 +1,45 @@
+// Host shim: inflate tinfl della ROM ESP32 (implementato con zlib)
+// Come la ROM: output in una finestra circolare da TINFL_LZ_DICT_SIZE e, in deflate
+// raw, lettura in anticipo nel bit buffer: a fine stream fino a 3 byte dopo l'ultimo
+// blocco restano consumati in m_bit_buf (m_num_bits), non restituiti all'input
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#define TINFL_LZ_DICT_SIZE 32768
+
+enum {
+  TINFL_FLAG_PARSE_ZLIB_HEADER = 1,
+  TINFL_FLAG_HAS_MORE_INPUT = 2,
+  TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF = 4,
+};
+
+typedef enum {
+  TINFL_STATUS_BAD_PARAM = -3,
+  TINFL_STATUS_ADLER32_MISMATCH = -2,
+  TINFL_STATUS_FAILED = -1,
+  TINFL_STATUS_DONE = 0,
+  TINFL_STATUS_NEEDS_MORE_INPUT = 1,
+  TINFL_STATUS_HAS_MORE_OUTPUT = 2,
+} tinfl_status;
+
+typedef uint32_t tinfl_bit_buf_t;
+
+struct tinfl_decompressor {
+  uint32_t m_num_bits;         // Bit validi in m_bit_buf (i meno significativi)
+  tinfl_bit_buf_t m_bit_buf;
+  void* stream;           // z_stream (allocato alla prima chiamata)
+  uint8_t lastByte;       // Ultimo byte di input consumato
+  uint8_t pending[4096];  // Output zlib non ancora consegnato
+  size_t pendingPos;
+  size_t pendingLen;
+  bool done;
+};
+
+#define tinfl_init(r) ((r)->m_num_bits = 0, (r)->m_bit_buf = 0, (r)->stream = nullptr, \
+                       (r)->pendingPos = (r)->pendingLen = 0, (r)->done = false)
+
+tinfl_status tinfl_decompress(tinfl_decompressor* r, const uint8_t* in, size_t* inSize,
+                              uint8_t* outStart, uint8_t* outNext, size_t* outSize,
+                              uint32_t flags);
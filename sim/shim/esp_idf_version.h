@@ -0,0 +1,6 @@
+// Host shim: il simulatore espone le API ESP-IDF 5.x
+#pragma once
+
+#define ESP_IDF_VERSION_MAJOR 5
+#define ESP_IDF_VERSION_MINOR 1
+#define ESP_IDF_VERSION_PATCH 0
@@ -0,0 +1,6 @@
+// Host shim: CRC32 della ROM ESP32 (polinomio 0xEDB88320, come esp_rom_crc32_le)
+#pragma once
+
+#include <cstdint>
+
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t* buf, uint32_t len);
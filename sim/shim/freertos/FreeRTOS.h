@@ -0,0 +1,25 @@
+// Host shim: FreeRTOS (single task, tempo virtuale)
+// Gli eventi vengono generati in modo sincrono dagli shim WiFi/SNTP, quindi
+// xEventGroupWaitBits non blocca mai: se i bit mancano avanza il clock del timeout
+#pragma once
+
+#include <cstdint>
+
+typedef uint32_t TickType_t;
+typedef uint32_t EventBits_t;
+typedef int BaseType_t;
+typedef struct SimEventGroup* EventGroupHandle_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+
+EventGroupHandle_t xEventGroupCreate();
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits);
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits);
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group);
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits,
+                                BaseType_t clearOnExit, BaseType_t waitForAll,
+                                TickType_t ticks);
+void vTaskDelay(TickType_t ticks);
@@ -0,0 +1,31 @@
+// Host shim: parser header JPEG compatibile con TJpgDec (solo baseline)
+#pragma once
+
+#include <cstdint>
+
+typedef enum {
+  JDR_OK = 0,
+  JDR_INTR,
+  JDR_INP,
+  JDR_MEM1,
+  JDR_MEM2,
+  JDR_PAR,
+  JDR_FMT1,
+  JDR_FMT2,
+  JDR_FMT3,
+} JRESULT;
+
+typedef struct {
+  uint16_t width;
+  uint16_t height;
+  void* device;
+} lgfxJdec;
+
+// Stesso ordine parametri di TJpgDec: pool di lavoro, dimensione pool, device
+JRESULT lgfx_jd_prepare(lgfxJdec* jd, uint32_t (*infunc)(void*, uint8_t*, uint32_t),
+                        void* pool, uint32_t sz_pool, void* dev);
+
+namespace sim {
+// Valida header (SOF baseline) e marker EOI, come farebbe un decode completo
+JRESULT checkJpeg(const uint8_t* data, uint32_t len, uint16_t* width, uint16_t* height);
+}  // namespace sim
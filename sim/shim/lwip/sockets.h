@@ -0,0 +1,6 @@
+// Host shim: select() e socket POSIX reali (il client parla con il server locale)
+#pragma once
+
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/time.h>
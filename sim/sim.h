@@ -0,0 +1,87 @@
+// Stato interno del simulatore condiviso tra i moduli sim_*.cpp
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace sim {
+
+// ===== OPTIONS (riga di comando) =====
+struct Options {
+  std::string stateDir = "sim_state";
+  std::string deviceId = "dev0";
+  std::string baseURL = "http://127.0.0.1:8080";
+  std::vector<std::string> reachableAPs;  // Vuoto = prima rete di config.h
+  bool noAP = false;                      // Nessuna rete raggiungibile
+  bool sdCard = false;                    // microSD inserita
+  int initialBatteryPct = 100;
+  uint64_t mac = 0x24587C000001ULL;
+  int64_t startEpoch = 1767261600;        // 2026-01-01 10:00 UTC (primo wake)
+  std::string buttonWake;                 // "" = nessuno, altrimenti "A"/"B"/"C"
+  bool ticklessIdle = false;              // Core con tickless idle (light sleep automatico)
+  bool verbose = false;
+};
+extern Options opts;
+
+// ===== ENERGY MODEL (mA) =====
+// Valori indicativi ESP32-S3 @ 4.2V, sovrascrivibili in sim_runtime.cpp
+const double MA_CPU_ACTIVE = 45.0;     // CPU a piena frequenza
+const double MA_CPU_DFS_IDLE = 15.0;   // Lock rilasciati, senza light sleep
+const double MA_CPU_LIGHT_SLEEP = 1.5; // Light sleep automatico
+const double MA_RADIO_SCAN = 120.0;    // Scan + associazione
+const double MA_RADIO_ACTIVE = 100.0;  // Connesso, CPU attiva (TX/RX)
+const double MA_RADIO_MODEM_SLEEP = 20.0;  // Connesso, modem sleep tra i beacon
+const double MA_DISPLAY_REFRESH = 200.0;
+const double MA_DEEP_SLEEP = 0.00928;
+const double BATTERY_MAH = 1800.0;
+
+enum RadioState { RADIO_OFF, RADIO_IDLE, RADIO_SCANNING, RADIO_CONNECTED };
+
+// ===== PER-WAKE STATS =====
+struct Stats {
+  uint64_t bytesRx = 0;
+  uint64_t bytesTx = 0;
+  int connections = 0;
+  int requests = 0;
+  int refreshes = 0;
+  uint64_t radioMs = 0;
+  uint64_t cpuActiveMs = 0;
+  uint64_t idleMs = 0;
+  uint64_t displayMs = 0;
+  double energyMAms = 0;  // mA * ms
+  std::vector<std::string> requestLog;
+};
+extern Stats stats;
+
+// ===== CLOCK + EVENTS =====
+void scheduleEvent(uint64_t delayMs, std::function<void()> fn);
+void pumpEvents(uint64_t untilMs);       // Esegue eventi scaduti avanzando il clock
+bool waitUntil(std::function<bool()> done, uint64_t timeoutMs);
+
+// ===== ENERGY ACCOUNTING =====
+void markEnergy();                       // Chiude il segmento corrente
+void setRadioState(RadioState state);
+RadioState radioState();
+void setCpuIdle(bool idle);              // Lock PM rilasciati
+void setLightSleepEnabled(bool enabled);
+void addDisplayRefresh(uint64_t ms);
+int32_t batteryPct();
+
+// ===== RTC / TIME =====
+bool rtcValid();
+void setRtcValid();
+int64_t epochNow();
+long tzOffset();
+
+// ===== STATE FILES =====
+std::string statePath(const std::string& name);
+std::string sdRoot();
+void loadPrefs();
+void savePrefs();
+
+// ===== LOG =====
+void log(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+
+}  // namespace sim
@@ -0,0 +1,103 @@
+// Simulatore: display e-ink (tempi di refresh) + validazione JPEG
+#include <vector>
+
+#include "M5Unified.h"
+#include "sim.h"
+
+m5::M5Unified M5;
+
+namespace fonts {
+const GFXfont FreeSans18pt7b = {18};
+const GFXfont FreeSans12pt7b = {12};
+const GFXfont Font0 = {0};
+}  // namespace fonts
+
+// Durata refresh per modalità EPD (ms)
+static uint64_t refreshMs(epd_mode_t mode) {
+  switch (mode) {
+    case epd_fastest: return 250;
+    case epd_fast: return 450;
+    case epd_text: return 900;
+    default: return 1600;
+  }
+}
+
+void m5::M5Unified::begin(const config_t&) {
+  if (sim::opts.buttonWake == "A") BtnA.setPressed(true);
+  if (sim::opts.buttonWake == "B") BtnB.setPressed(true);
+  if (sim::opts.buttonWake == "C") BtnC.setPressed(true);
+}
+
+int32_t m5::Power_Class::getBatteryLevel() { return sim::batteryPct(); }
+
+void M5GFX::display() {
+  if (!dirty_) return;
+  dirty_ = false;
+  sim::log("Display: refresh (mode %d)\n", mode_);
+  sim::addDisplayRefresh(refreshMs(mode_));
+}
+
+// Refresh parziale: stessa forma d'onda (tempo), meno pixel che cambiano
+void M5GFX::display(int32_t x, int32_t y, int32_t w, int32_t h) {
+  if (!dirty_) return;
+  dirty_ = false;
+  sim::log("Display: partial refresh %dx%d at %d,%d (mode %d)\n", w, h, x, y, mode_);
+  sim::addDisplayRefresh(refreshMs(mode_));
+}
+
+bool M5GFX::drawJpg(const uint8_t* data, uint32_t len, int32_t, int32_t, int32_t, int32_t,
+                    int32_t, int32_t, float, float) {
+  uint16_t w, h;
+  // Decode: ~1ms per KB su ESP32-S3
+  sim::advanceMs(50 + len / 1024);
+  if (sim::checkJpeg(data, len, &w, &h) != JDR_OK) return false;
+  dirty_ = true;
+  return true;
+}
+
+// ===== JPEG =====
+
+JRESULT sim::checkJpeg(const uint8_t* data, uint32_t len, uint16_t* width, uint16_t* height) {
+  if (len < 4 || data[0] != 0xFF || data[1] != 0xD8) return JDR_FMT1;
+
+  bool haveSize = false;
+  uint32_t pos = 2;
+  while (pos + 4 <= len) {
+    if (data[pos] != 0xFF) return JDR_FMT1;
+    uint8_t marker = data[pos + 1];
+    uint32_t segLen = (data[pos + 2] << 8) | data[pos + 3];
+
+    if (marker == 0xC0 || marker == 0xC1) {
+      if (pos + 9 > len) return JDR_INP;
+      *height = (data[pos + 5] << 8) | data[pos + 6];
+      *width = (data[pos + 7] << 8) | data[pos + 8];
+      haveSize = true;
+    } else if ((marker >= 0xC2 && marker <= 0xCF) && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+      return JDR_FMT3;  // Progressive / lossless: non supportati da TJpgDec
+    } else if (marker == 0xDA) {
+      break;  // Start of scan: dati entropy-coded fino a EOI
+    }
+    pos += 2 + segLen;
+  }
+
+  if (!haveSize) return JDR_INP;
+  // Un decode completo fallisce se manca EOI (file troncato)
+  if (len < 2 || data[len - 2] != 0xFF || data[len - 1] != 0xD9) return JDR_INP;
+  return JDR_OK;
+}
+
+JRESULT lgfx_jd_prepare(lgfxJdec* jd, uint32_t (*infunc)(void*, uint8_t*, uint32_t),
+                        void*, uint32_t, void* dev) {
+  std::vector<uint8_t> data;
+  uint8_t chunk[4096];
+  for (;;) {
+    uint32_t n = infunc(dev, chunk, sizeof(chunk));
+    if (n == 0) break;
+    data.insert(data.end(), chunk, chunk + n);
+  }
+  jd->device = dev;
+  jd->width = jd->height = 0;
+  JRESULT res = sim::checkJpeg(data.data(), data.size(), &jd->width, &jd->height);
+  // prepare legge solo l'header: EOI mancante non è un errore qui
+  return res == JDR_INP && jd->width > 0 ? JDR_OK : res;
+}
@@ -0,0 +1,339 @@
+// Simulatore: WiFi (eventi su clock virtuale) + TCP/HTTP reali verso il server locale
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+
+#include "HTTPClient.h"
+#include "WiFi.h"
+#include "sim.h"
+
+WiFiClass WiFi;
+
+// Tempi radio modellati (ms)
+static const uint64_t WIFI_ASSOC_MS = 1200;  // Scan + auth + DHCP
+static const uint64_t WIFI_SCAN_FAIL_MS = 2500;
+
+// ===== WIFI =====
+
+static bool apReachable(const char* ssid) {
+  if (sim::opts.noAP) return false;
+  if (sim::opts.reachableAPs.empty()) return true;
+  for (auto& ap : sim::opts.reachableAPs) {
+    if (ap == ssid) return true;
+  }
+  return false;
+}
+
+bool WiFiClass::mode(wifi_mode_t m) {
+  if (m == WIFI_OFF) {
+    generation_++;
+    status_ = WL_DISCONNECTED;
+    sim::setRadioState(sim::RADIO_OFF);
+  } else if (mode_ == WIFI_OFF) {
+    sim::setRadioState(sim::RADIO_IDLE);
+  }
+  mode_ = m;
+  return true;
+}
+
+wl_status_t WiFiClass::begin(const char* ssid, const char*) {
+  if (mode_ == WIFI_OFF) mode(WIFI_STA);
+  unsigned gen = ++generation_;
+  status_ = WL_DISCONNECTED;
+  sim::setRadioState(sim::RADIO_SCANNING);
+
+  if (apReachable(ssid)) {
+    sim::log("WiFi: associating to %s\n", ssid);
+    sim::scheduleEvent(WIFI_ASSOC_MS, [this, gen] {
+      if (gen != generation_) return;
+      status_ = WL_CONNECTED;
+      sim::setRadioState(sim::RADIO_CONNECTED);
+      dispatch(ARDUINO_EVENT_WIFI_STA_GOT_IP);
+    });
+  } else {
+    sim::scheduleEvent(WIFI_SCAN_FAIL_MS, [this, gen] {
+      if (gen != generation_) return;
+      status_ = WL_NO_SSID_AVAIL;
+      sim::setRadioState(sim::RADIO_IDLE);
+      dispatch(ARDUINO_EVENT_WIFI_STA_DISCONNECTED, WIFI_REASON_NO_AP_FOUND);
+    });
+  }
+  return status_;
+}
+
+bool WiFiClass::disconnect(bool wifiOff) {
+  generation_++;
+  bool wasConnected = (status_ == WL_CONNECTED);
+  status_ = WL_DISCONNECTED;
+  if (mode_ != WIFI_OFF) sim::setRadioState(sim::RADIO_IDLE);
+  if (wasConnected) dispatch(ARDUINO_EVENT_WIFI_STA_DISCONNECTED, WIFI_REASON_ASSOC_LEAVE);
+  if (wifiOff) mode(WIFI_OFF);
+  return true;
+}
+
+String WiFiClass::macAddress() const {
+  char buf[18];
+  uint64_t m = sim::opts.mac;
+  snprintf(buf, sizeof(buf), "%02X:%02X:%02X:%02X:%02X:%02X",
+           (unsigned)(m >> 40) & 0xFF, (unsigned)(m >> 32) & 0xFF, (unsigned)(m >> 24) & 0xFF,
+           (unsigned)(m >> 16) & 0xFF, (unsigned)(m >> 8) & 0xFF, (unsigned)m & 0xFF);
+  return String(buf);
+}
+
+int WiFiClass::onEvent(WiFiEventFuncCb cb) {
+  if (numCallbacks_ >= 8) return -1;
+  callbacks_[numCallbacks_] = cb;
+  return numCallbacks_++;
+}
+
+void WiFiClass::dispatch(WiFiEvent_t event, uint8_t reason) {
+  WiFiEventInfo_t info = {};
+  info.wifi_sta_disconnected.reason = reason;
+  for (int i = 0; i < numCallbacks_; i++) callbacks_[i](event, info);
+}
+
+// ===== WIFI CLIENT =====
+
+int WiFiClient::connect(const char* host, uint16_t port) {
+  stop();
+  if (WiFi.status() != WL_CONNECTED) return 0;
+
+  struct addrinfo hints = {};
+  struct addrinfo* res = nullptr;
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  char portStr[8];
+  snprintf(portStr, sizeof(portStr), "%u", port);
+  if (getaddrinfo(host, portStr, &hints, &res) != 0) return 0;
+
+  int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+  int ok = (fd >= 0) && ::connect(fd, res->ai_addr, res->ai_addrlen) == 0;
+  freeaddrinfo(res);
+  if (!ok) {
+    if (fd >= 0) close(fd);
+    return 0;
+  }
+
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  fd_ = fd;
+  eof_ = false;
+  bufPos_ = bufLen_ = 0;
+  sim::stats.connections++;
+  return 1;
+}
+
+size_t WiFiClient::write(const uint8_t* buf, size_t size) {
+  if (fd_ < 0) return 0;
+  ssize_t n = send(fd_, buf, size, MSG_NOSIGNAL);
+  if (n <= 0) return 0;
+  sim::stats.bytesTx += n;
+  return n;
+}
+
+bool WiFiClient::fill(bool block) {
+  if (bufPos_ < bufLen_) return true;
+  if (fd_ < 0 || eof_) return false;
+
+  ssize_t n = recv(fd_, buf_, sizeof(buf_), block ? 0 : MSG_DONTWAIT);
+  if (n > 0) {
+    bufPos_ = 0;
+    bufLen_ = n;
+    sim::stats.bytesRx += n;
+    return true;
+  }
+  if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) eof_ = true;
+  return false;
+}
+
+int WiFiClient::available() {
+  fill(false);
+  return bufLen_ - bufPos_;
+}
+
+int WiFiClient::read() {
+  if (!fill(false)) return -1;
+  return buf_[bufPos_++];
+}
+
+int WiFiClient::read(uint8_t* buf, size_t size) {
+  if (!fill(false)) return -1;
+  size_t n = std::min(size, bufLen_ - bufPos_);
+  memcpy(buf, buf_ + bufPos_, n);
+  bufPos_ += n;
+  return n;
+}
+
+int WiFiClient::peek() {
+  if (!fill(false)) return -1;
+  return buf_[bufPos_];
+}
+
+int WiFiClient::readTimeout(uint32_t timeoutMs) {
+  if (available() > 0) return read();
+  if (fd_ < 0 || eof_) return -1;
+
+  fd_set readSet;
+  FD_ZERO(&readSet);
+  FD_SET(fd_, &readSet);
+  struct timeval tv = {(time_t)(timeoutMs / 1000), (suseconds_t)((timeoutMs % 1000) * 1000)};
+  if (select(fd_ + 1, &readSet, nullptr, nullptr, &tv) <= 0) return -1;
+  return fill(true) ? buf_[bufPos_++] : -1;
+}
+
+uint8_t WiFiClient::connected() {
+  if (fd_ < 0) return 0;
+  fill(false);
+  return (bufPos_ < bufLen_) || !eof_;
+}
+
+void WiFiClient::stop() {
+  if (fd_ >= 0) close(fd_);
+  fd_ = -1;
+  eof_ = true;
+  bufPos_ = bufLen_ = 0;
+}
+
+// ===== HTTP CLIENT =====
+
+static std::string lower(std::string s) {
+  for (auto& c : s) c = tolower((unsigned char)c);
+  return s;
+}
+
+bool HTTPClient::begin(WiFiClient& client, const String& url) {
+  end();
+  std::string u = url.str();
+  bool https = u.compare(0, 8, "https://") == 0;
+  size_t hostStart = https ? 8 : (u.compare(0, 7, "http://") == 0 ? 7 : std::string::npos);
+  if (hostStart == std::string::npos) return false;
+
+  size_t pathStart = u.find('/', hostStart);
+  std::string hostPort = u.substr(hostStart, pathStart - hostStart);
+  path_ = pathStart == std::string::npos ? "/" : u.substr(pathStart);
+
+  size_t colon = hostPort.find(':');
+  host_ = hostPort.substr(0, colon);
+  port_ = colon == std::string::npos ? (https ? 443 : 80) : atoi(hostPort.substr(colon + 1).c_str());
+
+  client_ = &client;
+  extraHeaders_.clear();
+  headers_.clear();
+  size_ = -1;
+  chunked_ = false;
+  return true;
+}
+
+void HTTPClient::end() {
+  if (client_ != nullptr) client_->stop();
+  client_ = nullptr;
+}
+
+void HTTPClient::addHeader(const String& name, const String& value) {
+  extraHeaders_ += name.str() + ": " + value.str() + "\r\n";
+}
+
+void HTTPClient::collectHeaders(const char* keys[], const size_t count) {
+  wantedHeaders_.clear();
+  for (size_t i = 0; i < count; i++) wantedHeaders_.push_back(lower(keys[i]));
+}
+
+String HTTPClient::header(const char* name) {
+  auto it = headers_.find(lower(name));
+  return it == headers_.end() ? String() : String(it->second);
+}
+
+bool HTTPClient::hasHeader(const char* name) { return headers_.count(lower(name)) > 0; }
+
+String HTTPClient::errorToString(int error) {
+  switch (error) {
+    case HTTPC_ERROR_CONNECTION_REFUSED: return "connection refused";
+    case HTTPC_ERROR_CONNECTION_LOST: return "connection lost";
+    case HTTPC_ERROR_READ_TIMEOUT: return "read Timeout";
+    default: return String("error ") + String(error);
+  }
+}
+
+int HTTPClient::GET() {
+  if (client_ == nullptr) return HTTPC_ERROR_NOT_CONNECTED;
+  if (!client_->connect(host_.c_str(), port_)) return HTTPC_ERROR_CONNECTION_REFUSED;
+
+  std::string req = "GET " + path_ + (http10_ ? " HTTP/1.0\r\n" : " HTTP/1.1\r\n");
+  req += "Host: " + host_ + "\r\n";
+  req += "User-Agent: ESP32HTTPClient\r\n";
+  req += std::string("Connection: ") + (reuse_ && !http10_ ? "keep-alive" : "close") + "\r\n";
+  if (!http10_) req += "Accept-Encoding: identity;q=1,chunked;q=0.1,*;q=0\r\n";
+  req += "X-Sim-Device: " + sim::opts.deviceId + "\r\n";
+  req += extraHeaders_ + "\r\n";
+
+  if (client_->write((const uint8_t*)req.data(), req.size()) != req.size()) {
+    return HTTPC_ERROR_SEND_HEADER_FAILED;
+  }
+  sim::stats.requests++;
+  sim::stats.requestLog.push_back("GET " + path_);
+
+  // Status line + header
+  int code = 0;
+  bool firstLine = true;
+  for (;;) {
+    std::string line;
+    int ch;
+    while ((ch = client_->readTimeout(timeout_)) >= 0 && ch != '\n') line += (char)ch;
+    if (ch < 0) return client_->connected() ? HTTPC_ERROR_READ_TIMEOUT : HTTPC_ERROR_CONNECTION_LOST;
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+
+    if (firstLine) {
+      if (line.compare(0, 5, "HTTP/") != 0) return HTTPC_ERROR_NO_HTTP_SERVER;
+      code = atoi(line.substr(line.find(' ') + 1).c_str());
+      firstLine = false;
+      continue;
+    }
+    if (line.empty()) break;
+
+    size_t colon = line.find(':');
+    if (colon == std::string::npos) continue;
+    std::string name = lower(line.substr(0, colon));
+    std::string value = line.substr(colon + 1);
+    value.erase(0, value.find_first_not_of(' '));
+
+    if (name == "content-length") size_ = atoi(value.c_str());
+    if (name == "transfer-encoding" && lower(value) == "chunked") chunked_ = true;
+    for (auto& wanted : wantedHeaders_) {
+      if (wanted == name) headers_[name] = value;
+    }
+  }
+
+  if (chunked_) size_ = -1;
+  if (code == HTTP_CODE_NOT_MODIFIED || code == 204) size_ = 0;
+  return code;
+}
+
+String HTTPClient::getString() {
+  if (client_ == nullptr) return String();
+  std::string body;
+  int ch;
+
+  if (chunked_) {
+    for (;;) {
+      std::string line;
+      while ((ch = client_->readTimeout(timeout_)) >= 0 && ch != '\n') line += (char)ch;
+      if (ch < 0) break;
+      long len = strtol(line.c_str(), nullptr, 16);
+      if (len <= 0) break;
+      for (long i = 0; i < len && (ch = client_->readTimeout(timeout_)) >= 0; i++) body += (char)ch;
+      client_->readTimeout(timeout_);  // \r
+      client_->readTimeout(timeout_);  // \n
+    }
+  } else {
+    while ((size_ < 0 || (int)body.size() < size_) && (ch = client_->readTimeout(timeout_)) >= 0) {
+      body += (char)ch;
+    }
+  }
+  return String(body);
+}
@@ -0,0 +1,674 @@
+// Simulatore wake-cycle: clock virtuale, modello energetico, stato persistente
+// Ogni esecuzione = un wake del device: setup() gira fino a deep sleep o restart,
+// lo stato che sopravvive (NVS, RTC, SD, batteria) viene salvato in --state
+#include <getopt.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cctype>
+#include <chrono>
+#include <cstdarg>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <vector>
+
+#include "Arduino.h"
+#include "Preferences.h"
+#include "config.h"
+#include "esp_pm.h"
+#include "esp_sntp.h"
+#include "sim.h"
+
+void setup();
+void loop();
+
+namespace sim {
+
+Options opts;
+Stats stats;
+
+// ===== CLOCK =====
+// Tempo del wake = tempo reale (rete verso il server locale) + attese simulate
+static auto realStart = std::chrono::steady_clock::now();
+static uint64_t virtualOffsetMs = 0;
+
+uint64_t nowMs() {
+  auto real = std::chrono::steady_clock::now() - realStart;
+  return std::chrono::duration_cast<std::chrono::milliseconds>(real).count() + virtualOffsetMs;
+}
+
+struct PendingEvent {
+  uint64_t dueMs;
+  std::function<void()> fn;
+};
+static std::vector<PendingEvent> events;
+
+void scheduleEvent(uint64_t delayMs, std::function<void()> fn) {
+  events.push_back({nowMs() + delayMs, fn});
+}
+
+void pumpEvents(uint64_t untilMs) {
+  for (;;) {
+    auto next = events.end();
+    for (auto it = events.begin(); it != events.end(); ++it) {
+      if (it->dueMs <= untilMs && (next == events.end() || it->dueMs < next->dueMs)) next = it;
+    }
+    if (next == events.end()) return;
+
+    uint64_t now = nowMs();
+    if (next->dueMs > now) {
+      markEnergy();
+      virtualOffsetMs += next->dueMs - now;
+    }
+    auto fn = next->fn;
+    events.erase(next);
+    fn();
+  }
+}
+
+void advanceMs(uint64_t ms) {
+  uint64_t target = nowMs() + ms;
+  pumpEvents(target);
+  uint64_t now = nowMs();
+  if (target > now) {
+    markEnergy();
+    virtualOffsetMs += target - now;
+  }
+}
+
+bool waitUntil(std::function<bool()> done, uint64_t timeoutMs) {
+  uint64_t deadline = nowMs() + timeoutMs;
+  for (;;) {
+    if (done()) return true;
+    // Prossimo evento entro la deadline?
+    uint64_t nextDue = UINT64_MAX;
+    for (auto& e : events) nextDue = std::min(nextDue, e.dueMs);
+    if (nextDue > deadline) break;
+    pumpEvents(nextDue);
+  }
+  advanceMs(deadline > nowMs() ? deadline - nowMs() : 0);
+  return done();
+}
+
+const char* contentBaseURL() { return opts.baseURL.c_str(); }
+
+// ===== ENERGY =====
+static uint64_t lastMarkMs = 0;
+static RadioState radio = RADIO_OFF;
+static bool cpuIdle = false;
+static bool lightSleep = false;
+
+void markEnergy() {
+  uint64_t now = nowMs();
+  if (now <= lastMarkMs) return;
+  uint64_t dt = now - lastMarkMs;
+  lastMarkMs = now;
+
+  double cpu = MA_CPU_ACTIVE;
+  if (cpuIdle) cpu = lightSleep ? MA_CPU_LIGHT_SLEEP : MA_CPU_DFS_IDLE;
+
+  double rf = 0;
+  switch (radio) {
+    case RADIO_SCANNING: rf = MA_RADIO_SCAN; break;
+    case RADIO_CONNECTED: rf = cpuIdle ? MA_RADIO_MODEM_SLEEP : MA_RADIO_ACTIVE; break;
+    case RADIO_IDLE: rf = MA_RADIO_MODEM_SLEEP; break;
+    default: break;
+  }
+
+  if (radio != RADIO_OFF) stats.radioMs += dt;
+  if (cpuIdle) {
+    stats.idleMs += dt;
+  } else {
+    stats.cpuActiveMs += dt;
+  }
+  stats.energyMAms += (cpu + rf) * dt;
+}
+
+void setRadioState(RadioState state) {
+  markEnergy();
+  radio = state;
+}
+
+RadioState radioState() { return radio; }
+
+void setCpuIdle(bool idle) {
+  markEnergy();
+  cpuIdle = idle;
+}
+
+void setLightSleepEnabled(bool enabled) {
+  markEnergy();
+  lightSleep = enabled;
+}
+
+void addDisplayRefresh(uint64_t ms) {
+  markEnergy();
+  stats.refreshes++;
+  stats.displayMs += ms;
+  stats.energyMAms += MA_DISPLAY_REFRESH * ms;
+  virtualOffsetMs += ms;
+  lastMarkMs = nowMs();  // Tempo del refresh già contabilizzato sopra
+}
+
+// ===== RTC / TIME =====
+static int64_t wakeEpoch = 0;   // Epoch reale all'inizio del wake
+static bool rtcIsValid = false;
+
+bool rtcValid() { return rtcIsValid; }
+void setRtcValid() { rtcIsValid = true; }
+int64_t epochNow() { return wakeEpoch + (int64_t)(nowMs() / 1000); }
+
+// Offset POSIX "[+-]h[:mm[:ss]]" (positivo = a ovest di UTC)
+static long parseTzOffset(const char*& p) {
+  long sign = (*p == '-') ? -1 : 1;
+  if (*p == '-' || *p == '+') p++;
+  long seconds = strtol(p, (char**)&p, 10) * 3600;
+  if (*p == ':') seconds += strtol(p + 1, (char**)&p, 10) * 60;
+  if (*p == ':') seconds += strtol(p + 1, (char**)&p, 10);
+  return sign * seconds;
+}
+
+// Offset locale dalla TZ impostata dal firmware (setenv + tzset, o configTime)
+// Approssimazione: con un nome DST l'ora legale è sempre applicata (TZ fisso)
+long tzOffset() {
+  const char* p = getenv("TZ");
+  if (p == nullptr) return 0;
+  while (isalpha((unsigned char)*p)) p++;
+  long local = -parseTzOffset(p);
+  if (!isalpha((unsigned char)*p)) return local;
+  while (isalpha((unsigned char)*p)) p++;
+  if (*p == 0 || *p == ',') return local + 3600;
+  return -parseTzOffset(p);
+}
+
+// ===== STATE FILES =====
+std::string statePath(const std::string& name) { return opts.stateDir + "/" + name; }
+std::string sdRoot() { return statePath("sd"); }
+
+struct RtcState {
+  int64_t epoch = 0;
+  bool valid = false;
+  double batteryMAh = -1;
+  int wake = 0;
+  std::string cause = "poweron";
+  int64_t sleepFrom = 0;  // Inizio del deep sleep (wake da pulsante = prima di epoch)
+};
+
+static RtcState loadRtc() {
+  RtcState s;
+  std::ifstream in(statePath("rtc.txt"));
+  std::string key;
+  while (in >> key) {
+    if (key == "epoch") in >> s.epoch;
+    else if (key == "valid") in >> s.valid;
+    else if (key == "battery_mah") in >> s.batteryMAh;
+    else if (key == "wake") in >> s.wake;
+    else if (key == "cause") in >> s.cause;
+    else if (key == "sleep_from") in >> s.sleepFrom;
+  }
+  return s;
+}
+
+static void saveRtc(const RtcState& s) {
+  std::ofstream out(statePath("rtc.txt"));
+  out << "epoch " << s.epoch << "\nvalid " << s.valid << "\nbattery_mah " << s.batteryMAh
+      << "\nwake " << s.wake << "\ncause " << s.cause << "\nsleep_from " << s.sleepFrom << "\n";
+}
+
+// Variabili RTC_DATA_ATTR del firmware (sezione "rtc_data"): salvate al deep
+// sleep, ripristinate solo al wake da deep sleep (reset = valori iniziali)
+extern "C" char __start_rtc_data[] __attribute__((weak));
+extern "C" char __stop_rtc_data[] __attribute__((weak));
+
+static void loadRtcData() {
+  if (__start_rtc_data == nullptr) return;
+  std::ifstream in(statePath("rtc_data.bin"), std::ios::binary);
+  std::vector<char> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  if (data.size() == (size_t)(__stop_rtc_data - __start_rtc_data)) {
+    memcpy(__start_rtc_data, data.data(), data.size());
+  }
+}
+
+static void saveRtcData(bool deepSleep) {
+  if (__start_rtc_data == nullptr || !deepSleep) {
+    unlink(statePath("rtc_data.bin").c_str());
+    return;
+  }
+  std::ofstream out(statePath("rtc_data.bin"), std::ios::binary);
+  out.write(__start_rtc_data, __stop_rtc_data - __start_rtc_data);
+}
+
+static double batteryMAh = BATTERY_MAH;
+
+int32_t batteryPct() {
+  markEnergy();
+  double left = batteryMAh - stats.energyMAms / 3600000.0;
+  return std::max(0, std::min(100, (int)(left * 100.0 / BATTERY_MAH)));
+}
+
+// ===== LOG =====
+void log(const char* fmt, ...) {
+  if (!opts.verbose) return;
+  va_list args;
+  va_start(args, fmt);
+  fprintf(stderr, "[sim %s] ", opts.deviceId.c_str());
+  vfprintf(stderr, fmt, args);
+  va_end(args);
+}
+
+// ===== WAKE END =====
+struct SimDeepSleep {};
+struct SimRestart {};
+static uint64_t sleepUs = 0;
+static esp_sleep_wakeup_cause_t wakeCause = ESP_SLEEP_WAKEUP_UNDEFINED;
+
+}  // namespace sim
+
+// ===== ARDUINO CORE =====
+HardwareSerial Serial;
+EspClass ESP;
+
+size_t HardwareSerial::write(uint8_t c) { return write(&c, 1); }
+
+size_t HardwareSerial::write(const uint8_t* buf, size_t size) {
+  if (sim::opts.verbose) fwrite(buf, 1, size, stderr);
+  return size;
+}
+
+void EspClass::restart() { throw sim::SimRestart(); }
+
+uint64_t EspClass::getEfuseMac() {
+  // Come su ESP32: byte del MAC in ordine little-endian
+  uint64_t mac = 0;
+  for (int i = 0; i < 6; i++) mac |= ((sim::opts.mac >> (8 * (5 - i))) & 0xFF) << (8 * i);
+  return mac;
+}
+
+uint32_t esp_random() { return (uint32_t)random(); }
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t timeUs) {
+  sim::sleepUs = timeUs;
+  return ESP_OK;
+}
+
+void esp_deep_sleep_start() { throw sim::SimDeepSleep(); }
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause() { return sim::wakeCause; }
+
+esp_err_t esp_sleep_enable_ext0_wakeup(gpio_num_t pin, int) {
+  sim::log("Wake source: ext0 GPIO%d\n", (int)pin);
+  return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_ext1_wakeup(uint64_t mask, esp_sleep_ext1_wakeup_mode_t) {
+  sim::log("Wake source: ext1 mask 0x%llx\n", (unsigned long long)mask);
+  return ESP_OK;
+}
+
+// --button B = pulsante "avanti" (ext1)
+uint64_t esp_sleep_get_ext1_wakeup_status() {
+  return sim::wakeCause == ESP_SLEEP_WAKEUP_EXT1 && BUTTON_NEXT_PIN >= 0 ? (1ULL << BUTTON_NEXT_PIN) : 0;
+}
+
+bool getLocalTime(struct tm* info, uint32_t ms) {
+  if (!sim::rtcValid()) {
+    sim::waitUntil([] { return sim::rtcValid(); }, ms);
+    if (!sim::rtcValid()) return false;
+  }
+  time_t t = (time_t)(sim::epochNow() + sim::tzOffset());
+  gmtime_r(&t, info);
+  return true;
+}
+
+static sntp_sync_time_cb_t sntpCallback = nullptr;
+
+void sntp_set_time_sync_notification_cb(sntp_sync_time_cb_t callback) { sntpCallback = callback; }
+
+void configTime(long gmtOffsetSec, int daylightOffsetSec, const char*, const char*, const char*) {
+  // Come il core: TZ POSIX con offset invertito, ora legale di DAYLIGHT_OFFSET_SEC
+  char tz[48];
+  long stdOffset = -gmtOffsetSec, dstOffset = stdOffset - daylightOffsetSec;
+  snprintf(tz, sizeof(tz), "UTC%ld:%02ld:%02ldDST%ld:%02ld:%02ld", stdOffset / 3600,
+           labs(stdOffset / 60) % 60, labs(stdOffset) % 60, dstOffset / 3600,
+           labs(dstOffset / 60) % 60, labs(dstOffset) % 60);
+  setenv("TZ", tz, 1);
+  tzset();
+  if (sim::radioState() != sim::RADIO_CONNECTED) return;
+
+  // Risposta SNTP dopo ~1 RTT
+  sim::scheduleEvent(40, [] {
+    sim::setRtcValid();
+    if (sntpCallback != nullptr) {
+      struct timeval tv = {(time_t)sim::epochNow(), 0};
+      sntpCallback(&tv);
+    }
+  });
+}
+
+// ===== FREERTOS =====
+struct SimEventGroup {
+  EventBits_t bits = 0;
+};
+
+EventGroupHandle_t xEventGroupCreate() { return new SimEventGroup(); }
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits) {
+  return group->bits |= bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits) {
+  EventBits_t old = group->bits;
+  group->bits &= ~bits;
+  return old;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group) { return group->bits; }
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits,
+                                BaseType_t clearOnExit, BaseType_t waitForAll,
+                                TickType_t ticks) {
+  auto satisfied = [&] {
+    return waitForAll ? (group->bits & bits) == bits : (group->bits & bits) != 0;
+  };
+  sim::waitUntil(satisfied, ticks);
+  EventBits_t result = group->bits;
+  if (clearOnExit && satisfied()) group->bits &= ~bits;
+  return result;
+}
+
+void vTaskDelay(TickType_t ticks) { sim::advanceMs(ticks); }
+
+// ===== POWER MANAGEMENT =====
+struct SimPmLock {
+  esp_pm_lock_type_t type;
+  int count = 0;
+};
+
+static std::vector<SimPmLock*> pmLocks;
+static bool pmLightSleep = false;
+
+static void updateCpuIdle() {
+  bool held = false;
+  for (auto* lock : pmLocks) {
+    if (lock->count > 0 && lock->type != ESP_PM_APB_FREQ_MAX) held = true;
+  }
+  sim::setCpuIdle(!held);
+}
+
+esp_err_t esp_pm_configure(const void* config) {
+  // Come il core Arduino standard: senza CONFIG_FREERTOS_USE_TICKLESS_IDLE niente light sleep
+  bool lightSleep = ((const esp_pm_config_t*)config)->light_sleep_enable;
+  if (lightSleep && !sim::opts.ticklessIdle) return ESP_ERR_NOT_SUPPORTED;
+  pmLightSleep = lightSleep;
+  sim::setLightSleepEnabled(pmLightSleep);
+  return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_create(esp_pm_lock_type_t type, int, const char*,
+                             esp_pm_lock_handle_t* handle) {
+  auto* lock = new SimPmLock{type, 0};
+  pmLocks.push_back(lock);
+  *handle = lock;
+  return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t handle) {
+  handle->count++;
+  updateCpuIdle();
+  return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t handle) {
+  if (handle->count == 0) return ESP_ERR_INVALID_STATE;
+  handle->count--;
+  updateCpuIdle();
+  return ESP_OK;
+}
+
+// ===== PREFERENCES (NVS) =====
+// File prefs.txt: "<namespace> <key> <type> <hex>" per riga
+// Come nvs_set_*: chiavi oltre 15 caratteri rifiutate (ESP_ERR_NVS_KEY_TOO_LONG)
+static const size_t NVS_KEY_MAX_LEN = 15;
+
+struct PrefValue {
+  char type;
+  std::string data;
+};
+static std::map<std::string, std::map<std::string, PrefValue>> nvs;
+
+static std::string toHex(const std::string& s) {
+  static const char* digits = "0123456789abcdef";
+  std::string out;
+  for (unsigned char c : s) {
+    out += digits[c >> 4];
+    out += digits[c & 15];
+  }
+  return out.empty() ? "-" : out;
+}
+
+static std::string fromHex(const std::string& h) {
+  std::string out;
+  if (h == "-") return out;
+  for (size_t i = 0; i + 1 < h.size(); i += 2) out += (char)strtol(h.substr(i, 2).c_str(), nullptr, 16);
+  return out;
+}
+
+void sim::loadPrefs() {
+  std::ifstream in(statePath("prefs.txt"));
+  std::string ns, key, type, hex;
+  while (in >> ns >> key >> type >> hex) nvs[ns][key] = {type[0], fromHex(hex)};
+}
+
+void sim::savePrefs() {
+  std::ofstream out(statePath("prefs.txt"));
+  for (auto& ns : nvs) {
+    for (auto& kv : ns.second) {
+      out << ns.first << " " << kv.first << " " << kv.second.type << " " << toHex(kv.second.data) << "\n";
+    }
+  }
+}
+
+bool Preferences::begin(const char* name, bool readOnly) {
+  ns_ = name;
+  readOnly_ = readOnly;
+  open_ = true;
+  return true;
+}
+
+void Preferences::end() { open_ = false; }
+
+bool Preferences::clear() {
+  if (!open_ || readOnly_) return false;
+  nvs[ns_].clear();
+  return true;
+}
+
+bool Preferences::remove(const char* key) {
+  if (!open_ || readOnly_) return false;
+  return nvs[ns_].erase(key) > 0;
+}
+
+bool Preferences::isKey(const char* key) { return open_ && nvs[ns_].count(key) > 0; }
+
+static size_t putValue(bool ok, const std::string& ns, const char* key, char type, const std::string& data) {
+  if (!ok) return 0;
+  if (strlen(key) > NVS_KEY_MAX_LEN) {
+    sim::log("NVS: key \"%s\" too long (max %zu), not stored\n", key, NVS_KEY_MAX_LEN);
+    return 0;
+  }
+  nvs[ns][key] = {type, data};
+  return data.size();
+}
+
+size_t Preferences::putInt(const char* key, int32_t value) {
+  return putValue(open_ && !readOnly_, ns_, key, 'i', std::string((const char*)&value, 4));
+}
+
+size_t Preferences::putUInt(const char* key, uint32_t value) {
+  return putValue(open_ && !readOnly_, ns_, key, 'u', std::string((const char*)&value, 4));
+}
+
+size_t Preferences::putString(const char* key, const String& value) {
+  return putValue(open_ && !readOnly_, ns_, key, 's', value.str());
+}
+
+size_t Preferences::putBytes(const char* key, const void* value, size_t len) {
+  return putValue(open_ && !readOnly_, ns_, key, 'b', std::string((const char*)value, len));
+}
+
+int32_t Preferences::getInt(const char* key, int32_t defaultValue) {
+  if (!isKey(key) || nvs[ns_][key].data.size() != 4) return defaultValue;
+  int32_t v;
+  memcpy(&v, nvs[ns_][key].data.data(), 4);
+  return v;
+}
+
+uint32_t Preferences::getUInt(const char* key, uint32_t defaultValue) {
+  if (!isKey(key) || nvs[ns_][key].data.size() != 4) return defaultValue;
+  uint32_t v;
+  memcpy(&v, nvs[ns_][key].data.data(), 4);
+  return v;
+}
+
+String Preferences::getString(const char* key, const String& defaultValue) {
+  if (!isKey(key)) return defaultValue;
+  return String(nvs[ns_][key].data);
+}
+
+size_t Preferences::getBytesLength(const char* key) {
+  return isKey(key) ? nvs[ns_][key].data.size() : 0;
+}
+
+size_t Preferences::getBytes(const char* key, void* buf, size_t maxLen) {
+  if (!isKey(key)) return 0;
+  const std::string& d = nvs[ns_][key].data;
+  if (d.size() > maxLen) return 0;
+  memcpy(buf, d.data(), d.size());
+  return d.size();
+}
+
+// ===== MAIN =====
+
+static void usage() {
+  fprintf(stderr,
+          "Usage: mmpaper_sim --state DIR [options]\n"
+          "  --device ID        device id for reports (default dev0)\n"
+          "  --base-url URL     content server (default http://127.0.0.1:8080)\n"
+          "  --ap SSID          reachable WiFi network (repeatable)\n"
+          "  --no-ap            no WiFi network in range\n"
+          "  --sd               microSD inserted (<state>/sd)\n"
+          "  --battery PCT      initial battery level (first wake only)\n"
+          "  --mac HEX          device MAC (e.g. 24587c0000a1)\n"
+          "  --start-epoch N    UTC epoch of the first wake\n"
+          "  --button A|B       this wake is a button press (A = ext0 redraw, B = ext1 next)\n"
+          "  --tickless-idle    core built with tickless idle (default: stock Arduino, no light sleep)\n"
+          "  --verbose          print firmware serial log to stderr\n");
+}
+
+int main(int argc, char** argv) {
+  using namespace sim;
+
+  static struct option longOpts[] = {
+      {"state", required_argument, nullptr, 's'},   {"device", required_argument, nullptr, 'd'},
+      {"base-url", required_argument, nullptr, 'u'}, {"ap", required_argument, nullptr, 'a'},
+      {"no-ap", no_argument, nullptr, 'n'},          {"sd", no_argument, nullptr, 'c'},
+      {"battery", required_argument, nullptr, 'b'},  {"mac", required_argument, nullptr, 'm'},
+      {"start-epoch", required_argument, nullptr, 'e'}, {"button", required_argument, nullptr, 'p'},
+      {"tickless-idle", no_argument, nullptr, 't'},  {"verbose", no_argument, nullptr, 'v'},
+      {"help", no_argument, nullptr, 'h'},
+      {nullptr, 0, nullptr, 0}};
+
+  int c;
+  while ((c = getopt_long(argc, argv, "", longOpts, nullptr)) != -1) {
+    switch (c) {
+      case 's': opts.stateDir = optarg; break;
+      case 'd': opts.deviceId = optarg; break;
+      case 'u': opts.baseURL = optarg; break;
+      case 'a': opts.reachableAPs.push_back(optarg); break;
+      case 'n': opts.noAP = true; break;
+      case 'c': opts.sdCard = true; break;
+      case 'b': opts.initialBatteryPct = atoi(optarg); break;
+      case 'm': opts.mac = strtoull(optarg, nullptr, 16); break;
+      case 'e': opts.startEpoch = strtoll(optarg, nullptr, 10); break;
+      case 'p': opts.buttonWake = optarg; break;
+      case 't': opts.ticklessIdle = true; break;
+      case 'v': opts.verbose = true; break;
+      default: usage(); return 2;
+    }
+  }
+
+  unsetenv("TZ");  // Al boot il device non ha fuso orario (UTC)
+  mkdir(opts.stateDir.c_str(), 0755);
+  if (opts.sdCard) mkdir(sdRoot().c_str(), 0755);
+  srandom((unsigned)(opts.mac ^ std::hash<std::string>()(opts.deviceId)));
+
+  RtcState rtc = loadRtc();
+  if (rtc.epoch == 0) rtc.epoch = opts.startEpoch;
+  if (rtc.batteryMAh < 0) rtc.batteryMAh = BATTERY_MAH * opts.initialBatteryPct / 100.0;
+  batteryMAh = rtc.batteryMAh;
+  wakeEpoch = rtc.epoch;
+  rtcIsValid = rtc.valid;
+
+  if (!opts.buttonWake.empty()) {
+    // Pressione a metà del deep sleep precedente (prima del prossimo check)
+    wakeCause = (opts.buttonWake == "B") ? ESP_SLEEP_WAKEUP_EXT1 : ESP_SLEEP_WAKEUP_EXT0;
+    if (rtc.sleepFrom > 0 && rtc.epoch > rtc.sleepFrom) {
+      wakeEpoch = rtc.sleepFrom + (rtc.epoch - rtc.sleepFrom) / 2;
+    }
+  } else if (rtc.cause == "timer") {
+    wakeCause = ESP_SLEEP_WAKEUP_TIMER;
+  }
+  if (rtc.cause == "timer") loadRtcData();  // Il wake precedente è finito in deep sleep
+  loadPrefs();
+
+  std::string end = "returned";
+  try {
+    setup();
+    loop();
+  } catch (SimDeepSleep&) {
+    end = "deep_sleep";
+  } catch (SimRestart&) {
+    end = "restart";
+  }
+  markEnergy();
+
+  uint64_t awakeMs = nowMs();
+  uint64_t sleepS = (end == "deep_sleep") ? sleepUs / 1000000ULL : 0;
+  double awakeMAh = stats.energyMAms / 3600000.0;
+  double sleepMAh = MA_DEEP_SLEEP * sleepS / 3600.0;
+
+  // Persisti lo stato per il prossimo wake
+  savePrefs();
+  saveRtcData(end == "deep_sleep");
+  rtc.batteryMAh = std::max(0.0, batteryMAh - awakeMAh - sleepMAh);
+  rtc.sleepFrom = wakeEpoch + (int64_t)((awakeMs + 999) / 1000);
+  rtc.epoch = rtc.sleepFrom + (int64_t)sleepS;
+  rtc.valid = rtcIsValid;
+  rtc.cause = (end == "deep_sleep") ? "timer" : "reset";
+  rtc.wake++;
+  saveRtc(rtc);
+
+  // Report (una riga JSON per wake)
+  printf("{\"device\":\"%s\",\"wake\":%d,\"epoch\":%lld,\"cause\":\"%s\",\"end\":\"%s\","
+         "\"awake_ms\":%llu,\"cpu_active_ms\":%llu,\"idle_ms\":%llu,\"radio_ms\":%llu,"
+         "\"display_ms\":%llu,\"refreshes\":%d,\"bytes_rx\":%llu,\"bytes_tx\":%llu,"
+         "\"connections\":%d,\"requests\":%d,\"round_trips\":%d,\"sleep_s\":%llu,"
+         "\"energy_awake_mah\":%.4f,\"energy_sleep_mah\":%.4f,\"battery_pct\":%.1f,"
+         "\"requests_log\":[",
+         opts.deviceId.c_str(), rtc.wake, (long long)wakeEpoch,
+         !opts.buttonWake.empty() ? "button" : (wakeCause == ESP_SLEEP_WAKEUP_TIMER ? "timer" : "reset"),
+         end.c_str(), (unsigned long long)awakeMs, (unsigned long long)stats.cpuActiveMs,
+         (unsigned long long)stats.idleMs, (unsigned long long)stats.radioMs,
+         (unsigned long long)stats.displayMs, stats.refreshes,
+         (unsigned long long)stats.bytesRx, (unsigned long long)stats.bytesTx, stats.connections,
+         stats.requests, stats.connections + stats.requests, (unsigned long long)sleepS,
+         awakeMAh, sleepMAh, rtc.batteryMAh * 100.0 / BATTERY_MAH);
+  for (size_t i = 0; i < stats.requestLog.size(); i++) {
+    printf("%s\"%s\"", i ? "," : "", stats.requestLog[i].c_str());
+  }
+  printf("]}\n");
+  return 0;
+}
@@ -0,0 +1,395 @@
+// Simulatore: microSD su filesystem host, partizioni flash, OTA fittizio, MD5, CRC32, inflate
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "MD5Builder.h"
+#include "SD.h"
+#include "SPI.h"
+#include "Update.h"
+#include "esp32/rom/miniz.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#include "sim.h"
+
+SPIClass SPI;
+SDFS SD;
+UpdateClass Update;
+
+// ===== SD / FILE =====
+
+struct SimFileImpl {
+  std::string path;   // Path sulla SD (es. /mmpaper/index.txt)
+  std::string name;   // Solo nome file
+  FILE* fp = nullptr;
+  DIR* dir = nullptr;
+  bool isDir = false;
+  size_t size = 0;
+  ~SimFileImpl() {
+    if (fp) fclose(fp);
+    if (dir) closedir(dir);
+  }
+};
+
+static std::string hostPath(const char* path) { return sim::sdRoot() + path; }
+
+static std::shared_ptr<SimFileImpl> openImpl(const std::string& path, const char* mode) {
+  auto impl = std::make_shared<SimFileImpl>();
+  impl->path = path;
+  impl->name = path.substr(path.rfind('/') + 1);
+
+  std::string host = hostPath(path.c_str());
+  struct stat st;
+  bool exists = stat(host.c_str(), &st) == 0;
+
+  if (exists && S_ISDIR(st.st_mode)) {
+    impl->isDir = true;
+    impl->dir = opendir(host.c_str());
+    return impl->dir ? impl : nullptr;
+  }
+  if (!exists && strcmp(mode, FILE_READ) == 0) return nullptr;
+
+  const char* fmode = strcmp(mode, FILE_READ) == 0 ? "rb" : (strcmp(mode, FILE_APPEND) == 0 ? "ab" : "wb");
+  impl->fp = fopen(host.c_str(), fmode);
+  if (!impl->fp) return nullptr;
+  impl->size = exists && strcmp(mode, FILE_WRITE) != 0 ? st.st_size : 0;
+  return impl;
+}
+
+bool SDFS::begin(uint8_t, SPIClass&, uint32_t, const char*, uint8_t) {
+  struct stat st;
+  mounted_ = sim::opts.sdCard && stat(sim::sdRoot().c_str(), &st) == 0;
+  return mounted_;
+}
+
+File SDFS::open(const char* path, const char* mode) {
+  if (!mounted_) return File();
+  return File(openImpl(path, mode));
+}
+
+bool SDFS::exists(const char* path) {
+  struct stat st;
+  return mounted_ && stat(hostPath(path).c_str(), &st) == 0;
+}
+
+bool SDFS::mkdir(const char* path) { return mounted_ && ::mkdir(hostPath(path).c_str(), 0755) == 0; }
+
+bool SDFS::remove(const char* path) { return mounted_ && unlink(hostPath(path).c_str()) == 0; }
+
+bool SDFS::rename(const char* from, const char* to) {
+  return mounted_ && ::rename(hostPath(from).c_str(), hostPath(to).c_str()) == 0;
+}
+
+size_t File::write(const uint8_t* buf, size_t size) {
+  if (!impl_ || !impl_->fp) return 0;
+  size_t n = fwrite(buf, 1, size, impl_->fp);
+  impl_->size += n;
+  return n;
+}
+
+int File::available() {
+  if (!impl_ || !impl_->fp) return 0;
+  return impl_->size - ftell(impl_->fp);
+}
+
+int File::read() {
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+size_t File::read(uint8_t* buf, size_t size) {
+  if (!impl_ || !impl_->fp) return 0;
+  return fread(buf, 1, size, impl_->fp);
+}
+
+int File::peek() {
+  if (!impl_ || !impl_->fp) return -1;
+  int c = fgetc(impl_->fp);
+  if (c != EOF) ungetc(c, impl_->fp);
+  return c == EOF ? -1 : c;
+}
+
+bool File::seek(uint32_t pos) { return impl_ && impl_->fp && fseek(impl_->fp, pos, SEEK_SET) == 0; }
+
+size_t File::position() const { return impl_ && impl_->fp ? ftell(impl_->fp) : 0; }
+
+size_t File::size() const { return impl_ ? impl_->size : 0; }
+
+const char* File::name() const { return impl_ ? impl_->name.c_str() : ""; }
+
+const char* File::path() const { return impl_ ? impl_->path.c_str() : ""; }
+
+bool File::isDirectory() const { return impl_ && impl_->isDir; }
+
+File File::openNextFile(const char* mode) {
+  if (!impl_ || !impl_->dir) return File();
+  for (struct dirent* e = readdir(impl_->dir); e; e = readdir(impl_->dir)) {
+    if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+    return File(openImpl(impl_->path + "/" + e->d_name, mode));
+  }
+  return File();
+}
+
+void File::close() { impl_.reset(); }
+
+File::operator bool() const { return impl_ != nullptr; }
+
+// ===== FLASH PARTITION =====
+
+// Tabella partitions.csv: solo la partizione dati usata dal firmware
+static const esp_partition_t IMAGE_PARTITION = {
+    ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)0x40, 0xc90000, 0x360000, "mmimages", false};
+
+// Tempi indicativi NOR flash: erase settore ~25ms, program ~1.5ms/KB
+static const uint64_t FLASH_ERASE_MS_PER_SECTOR = 25;
+static const double FLASH_WRITE_MS_PER_KB = 1.5;
+
+// File immagine della partizione, creato a 0xFF (flash cancellata) al primo uso
+static int partitionFd(const esp_partition_t* part) {
+  static int fd = -1;
+  if (fd >= 0) return fd;
+
+  std::string path = sim::statePath(std::string("flash_") + part->label + ".bin");
+  struct stat st;
+  bool exists = stat(path.c_str(), &st) == 0 && (uint32_t)st.st_size == part->size;
+  fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd >= 0 && !exists) {
+    std::vector<uint8_t> erased(part->size, 0xFF);
+    if (pwrite(fd, erased.data(), erased.size(), 0) != (ssize_t)erased.size()) {
+      close(fd);
+      fd = -1;
+    }
+  }
+  return fd;
+}
+
+static bool partitionRangeOk(const esp_partition_t* part, size_t offset, size_t size) {
+  return part == &IMAGE_PARTITION && offset + size <= part->size && partitionFd(part) >= 0;
+}
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type,
+                                                esp_partition_subtype_t subtype,
+                                                const char* label) {
+  if (type != IMAGE_PARTITION.type) return nullptr;
+  if (subtype != ESP_PARTITION_SUBTYPE_ANY && subtype != IMAGE_PARTITION.subtype) return nullptr;
+  if (label && strcmp(label, IMAGE_PARTITION.label) != 0) return nullptr;
+  return &IMAGE_PARTITION;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t* part, size_t offset, void* dst, size_t size) {
+  if (!partitionRangeOk(part, offset, size)) return ESP_ERR_INVALID_ARG;
+  return pread(partitionFd(part), dst, size, offset) == (ssize_t)size ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t* part, size_t offset, const void* src, size_t size) {
+  if (!partitionRangeOk(part, offset, size)) return ESP_ERR_INVALID_ARG;
+
+  // NOR: 1 → 0 soltanto; scrivere su un'area non cancellata corrompe i dati
+  std::vector<uint8_t> cur(size);
+  if (pread(partitionFd(part), cur.data(), size, offset) != (ssize_t)size) return ESP_FAIL;
+  const uint8_t* in = (const uint8_t*)src;
+  for (size_t i = 0; i < size; i++) cur[i] &= in[i];
+
+  sim::advanceMs((uint64_t)(size / 1024.0 * FLASH_WRITE_MS_PER_KB));
+  return pwrite(partitionFd(part), cur.data(), size, offset) == (ssize_t)size ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* part, size_t offset, size_t size) {
+  if (offset % SPI_FLASH_SEC_SIZE || size % SPI_FLASH_SEC_SIZE) return ESP_ERR_INVALID_SIZE;
+  if (!partitionRangeOk(part, offset, size)) return ESP_ERR_INVALID_ARG;
+
+  std::vector<uint8_t> erased(size, 0xFF);
+  sim::advanceMs(size / SPI_FLASH_SEC_SIZE * FLASH_ERASE_MS_PER_SECTOR);
+  return pwrite(partitionFd(part), erased.data(), size, offset) == (ssize_t)size ? ESP_OK : ESP_FAIL;
+}
+
+// ===== CRC32 =====
+
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t* buf, uint32_t len) {
+  crc = ~crc;
+  for (uint32_t i = 0; i < len; i++) {
+    crc ^= buf[i];
+    for (int b = 0; b < 8; b++) crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+  }
+  return ~crc;
+}
+
+// ===== INFLATE (ROM MINIZ) =====
+
+tinfl_status tinfl_decompress(tinfl_decompressor* r, const uint8_t* in, size_t* inSize,
+                              uint8_t* outStart, uint8_t* outNext, size_t* outSize,
+                              uint32_t flags) {
+  (void)outStart;
+  z_stream* zs = (z_stream*)r->stream;
+  if (zs == nullptr) {
+    zs = new z_stream();
+    // La ROM non ha un deinit: il decompressor viene liberato con free() dal firmware
+    if (inflateInit2(zs, (flags & TINFL_FLAG_PARSE_ZLIB_HEADER) ? 15 : -15) != Z_OK) {
+      return TINFL_STATUS_FAILED;
+    }
+    r->stream = zs;
+  }
+
+  // Nuovo input solo quando l'output precedente è stato consegnato
+  size_t consumed = 0;
+  if (r->pendingLen == 0 && !r->done) {
+    zs->next_in = (Bytef*)in;
+    zs->avail_in = *inSize;
+    zs->next_out = r->pending;
+    zs->avail_out = sizeof(r->pending);
+    int res = inflate(zs, Z_NO_FLUSH);
+    if (res != Z_OK && res != Z_STREAM_END && res != Z_BUF_ERROR) {
+      return TINFL_STATUS_FAILED;
+    }
+    consumed = *inSize - zs->avail_in;
+    if (consumed > 0) r->lastByte = in[consumed - 1];
+    r->pendingPos = 0;
+    r->pendingLen = sizeof(r->pending) - zs->avail_out;
+    r->done = (res == Z_STREAM_END);
+
+    // Deflate raw: la ROM ha già nel bit buffer i bit non usati dell'ultimo byte
+    // più i byte letti in anticipo (fino a 3, se disponibili nell'input)
+    if (r->done && !(flags & TINFL_FLAG_PARSE_ZLIB_HEADER)) {
+      int unused = zs->data_type & 7;
+      r->m_bit_buf = unused ? r->lastByte >> (8 - unused) : 0;
+      r->m_num_bits = unused;
+      for (int i = 0; i < 3 && consumed < *inSize; i++) {
+        r->m_bit_buf |= (tinfl_bit_buf_t)in[consumed++] << r->m_num_bits;
+        r->m_num_bits += 8;
+      }
+    }
+  }
+  *inSize = consumed;
+
+  size_t n = r->pendingLen < *outSize ? r->pendingLen : *outSize;
+  memcpy(outNext, r->pending + r->pendingPos, n);
+  r->pendingPos += n;
+  r->pendingLen -= n;
+  *outSize = n;
+
+  if (r->pendingLen > 0 || (!r->done && zs->avail_out == 0)) return TINFL_STATUS_HAS_MORE_OUTPUT;
+  if (r->done) return TINFL_STATUS_DONE;
+  return TINFL_STATUS_NEEDS_MORE_INPUT;
+}
+
+// ===== UPDATE (OTA) =====
+
+bool UpdateClass::begin(size_t size) {
+  size_ = size;
+  written_ = 0;
+  active_ = true;
+  finished_ = false;
+  error_ = "No Error";
+  return true;
+}
+
+size_t UpdateClass::write(uint8_t*, size_t len) {
+  if (!active_) return 0;
+  written_ += len;
+  return len;
+}
+
+bool UpdateClass::end(bool evenIfRemaining) {
+  if (!active_) return false;
+  active_ = false;
+  if (size_ != UPDATE_SIZE_UNKNOWN && written_ != size_ && !evenIfRemaining) {
+    error_ = "Not Enough Data";
+    return false;
+  }
+  finished_ = true;
+  return true;
+}
+
+// ===== MD5 (RFC 1321) =====
+
+static const uint32_t MD5_K[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+    0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+    0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+    0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+    0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+    0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391};
+
+static const uint8_t MD5_R[64] = {7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+                                  5, 9,  14, 20, 5, 9,  14, 20, 5, 9,  14, 20, 5, 9,  14, 20,
+                                  4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+                                  6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21};
+
+void MD5Builder::begin() {
+  state_[0] = 0x67452301;
+  state_[1] = 0xefcdab89;
+  state_[2] = 0x98badcfe;
+  state_[3] = 0x10325476;
+  count_ = 0;
+  memset(digest_, 0, sizeof(digest_));
+}
+
+void MD5Builder::transform(const uint8_t block[64]) {
+  uint32_t m[16];
+  for (int i = 0; i < 16; i++) {
+    m[i] = block[i * 4] | (block[i * 4 + 1] << 8) | (block[i * 4 + 2] << 16) | ((uint32_t)block[i * 4 + 3] << 24);
+  }
+  uint32_t a = state_[0], b = state_[1], c = state_[2], d = state_[3];
+  for (int i = 0; i < 64; i++) {
+    uint32_t f;
+    int g;
+    if (i < 16) { f = (b & c) | (~b & d); g = i; }
+    else if (i < 32) { f = (d & b) | (~d & c); g = (5 * i + 1) % 16; }
+    else if (i < 48) { f = b ^ c ^ d; g = (3 * i + 5) % 16; }
+    else { f = c ^ (b | ~d); g = (7 * i) % 16; }
+    uint32_t tmp = d;
+    d = c;
+    c = b;
+    uint32_t x = a + f + MD5_K[i] + m[g];
+    b = b + ((x << MD5_R[i]) | (x >> (32 - MD5_R[i])));
+    a = tmp;
+  }
+  state_[0] += a;
+  state_[1] += b;
+  state_[2] += c;
+  state_[3] += d;
+}
+
+void MD5Builder::add(const uint8_t* data, size_t len) {
+  size_t used = count_ % 64;
+  count_ += len;
+  while (len > 0) {
+    size_t n = std::min(len, 64 - used);
+    memcpy(buffer_ + used, data, n);
+    used += n;
+    data += n;
+    len -= n;
+    if (used == 64) {
+      transform(buffer_);
+      used = 0;
+    }
+  }
+}
+
+void MD5Builder::calculate() {
+  uint64_t bits = count_ * 8;
+  uint8_t pad = 0x80;
+  add(&pad, 1);
+  uint8_t zero = 0;
+  while (count_ % 64 != 56) add(&zero, 1);
+  uint8_t len[8];
+  for (int i = 0; i < 8; i++) len[i] = (bits >> (8 * i)) & 0xFF;
+  add(len, 8);
+  for (int i = 0; i < 4; i++) {
+    for (int j = 0; j < 4; j++) digest_[i * 4 + j] = (state_[i] >> (8 * j)) & 0xFF;
+  }
+}
+
+void MD5Builder::getChars(char* output) const {
+  for (int i = 0; i < 16; i++) sprintf(output + i * 2, "%02x", digest_[i]);
+}
+
+String MD5Builder::toString() const {
+  char out[33];
+  getChars(out);
+  return String(out);
+}
@@ -2,9 +2,24 @@
 #include <M5Unified.h>
 #include <Preferences.h>
 #include <WiFi.h>
+#include <WiFiClientSecure.h>
 #include <HTTPClient.h>
 #include <Update.h>
+#include <SPI.h>
+#include <SD.h>
+#include <MD5Builder.h>
 #include <time.h>
+#include <lwip/sockets.h>
+#include "esp_idf_version.h"
+#include "esp_partition.h"
+#include "esp_pm.h"
+#include "esp_rom_crc.h"
+#if CONFIG_IDF_TARGET_ESP32S3
+#include "esp32s3/rom/miniz.h"
+#else
+#include "esp32/rom/miniz.h"
+#endif
+#include "esp_sntp.h"
 #include "config.h"
 #include "lgfx/utility/lgfx_tjpgd.h"  // For JPEG dimension parsing
 
@@ -12,17 +27,282 @@
 Preferences prefs;
 bool isFirstBoot = true;  // Flag per controllo update al primo avvio
 
+// ===== NETWORK EVENTS =====
+EventGroupHandle_t netEvents = nullptr;
+const EventBits_t EVT_WIFI_CONNECTED = BIT0;  // GOT_IP ricevuto
+const EventBits_t EVT_WIFI_FAILED = BIT1;     // AP non trovato: inutile aspettare
+const EventBits_t EVT_TIME_SYNCED = BIT2;     // Callback SNTP ricevuta
+
+bool radioAllowed = true;  // false nel percorso veloce da pulsante: WiFi vietato
+
+// Client HTTP gestiti da noi: serve il socket per attendere i dati con select()
+WiFiClientSecure tlsClient;
+WiFiClient tcpClient;
+bool httpUsingTLS = false;
+
+// Stato lettura body HTTP (decompressione gzip/deflate in streaming)
+enum BodyEncoding { BODY_IDENTITY, BODY_GZIP, BODY_DEFLATE };
+struct HttpBody {
+  WiFiClient* stream;
+  int remaining;                 // Byte ancora attesi sullo stream, -1 = fino a chiusura
+  BodyEncoding encoding;
+  tinfl_decompressor* inflator;
+  uint32_t flags;                // Flag tinfl (header zlib o deflate raw)
+  uint8_t* window;               // Finestra circolare TINFL_LZ_DICT_SIZE (dizionario + output)
+  size_t windowPos;              // Prossima scrittura nella finestra
+  size_t pendingPos;             // Output decompresso non ancora consegnato
+  size_t pendingLen;
+  bool moreOutput;               // tinfl ha altro output senza bisogno di nuovo input
+  uint8_t* in;                   // Input compresso (HTTP_INPUT_CHUNK)
+  size_t inPos;
+  size_t inLen;
+  uint32_t crc;                  // CRC32 dell'output (trailer gzip)
+  size_t total;                  // Byte consegnati
+  bool finished;
+  bool trailerChecked;
+  bool failed;
+};
+
+// ===== POWER MANAGEMENT =====
+esp_pm_lock_handle_t pmCpuLock = nullptr;    // Tiene la CPU a CPU_MAX_FREQ_MHZ
+esp_pm_lock_handle_t pmSleepLock = nullptr;  // Impedisce il light sleep automatico
+bool pmIdleAllowed = false;
+
 // ===== IMAGE MANAGEMENT =====
 uint8_t* imageBuffer = nullptr;  // Buffer per immagine JPEG
 size_t imageBufferSize = 0;
+bool previewDisplayed = false;   // Anteprima layered già a schermo in questo wake
+uint64_t tileRefreshMask = 0;    // Tile cambiate da aggiornare a schermo (0 = refresh completo)
+String imageDir = "";            // Cartella contenuti sul server ("image" o target del manifest)
+
+// ===== SD CONTENT STORE =====
+bool sdMounted = false;          // SD montata e cartella contenuti pronta
+String sdIndex = "";             // Copia in RAM di SD_INDEX_FILE
+bool networkUnavailable = false; // WiFi fallito in questo wake → usa contenuti SD
+
+// ===== IMAGE SLOTS (FLASH A/B) =====
+// Header di uno slot immagine (primo settore dello slot)
+// Lo slot attivo è quello valido (magic + CRC) con seq più alto:
+// scrivere l'header dello slot nuovo è lo "switch" atomico
+struct ImageSlotHeader {
+  uint32_t magic;       // IMAGE_SLOT_MAGIC
+  uint32_t seq;         // Incrementale a ogni commit
+  uint32_t size;        // Byte JPEG
+  char md5[33];         // MD5 hex del JPEG
+  uint8_t reserved[3];
+  uint32_t crc;         // CRC32 dei campi precedenti
+};
+const uint32_t IMAGE_SLOT_MAGIC = 0x53494D4D;  // "MMIS" little-endian
+const esp_partition_t* imageSlotPartition = nullptr;
+uint32_t imageSlotSize = 0;      // Byte per slot (header + dati)
+int activeImageSlot = -1;        // 0 = A, 1 = B, -1 = nessuna immagine valida
+ImageSlotHeader activeSlotHeader;
+
+// ===== RUNTIME CONFIG =====
+// Blob binario in NVS (chiave "config", generato da make_config.py)
+// Interi little-endian, stringhe terminate da NUL
+struct RuntimeWiFi {
+  char ssid[33];
+  char password[65];
+};
+struct RuntimeConfig {
+  uint32_t magic;                   // RUNTIME_CONFIG_MAGIC
+  uint16_t version;                 // RUNTIME_CONFIG_VERSION
+  uint16_t size;                    // sizeof(RuntimeConfig)
+  uint32_t seq;                     // "config_seq" del manifest
+  uint32_t checkHours;              // Bit n = check immagine alle n:00
+  uint32_t fullRefreshMinInterval;  // ms tra full refresh
+  uint16_t fetchJitterSeconds;
+  uint8_t minBatteryPercent;
+  uint8_t previewOnlyBatteryPercent;
+  uint8_t fetchWindowMinutes;
+  uint8_t partialRefreshMaxCount;
+  uint8_t wifiCount;                // Reti in wifi[] (0 = solo WIFI_NETWORKS)
+  uint8_t reserved;
+  char baseUrl[128];                // Senza "/" finale, "" = CONTENT_BASE_URL
+  char deviceGroup[32];             // Come DEVICE_GROUP
+  RuntimeWiFi wifi[RUNTIME_CONFIG_WIFI_MAX];
+  uint8_t reserved2[2];
+  uint32_t crc;                     // CRC32 dei campi precedenti
+};
+static_assert(sizeof(RuntimeConfig) == 488, "RuntimeConfig layout must match make_config.py");
+const uint32_t RUNTIME_CONFIG_MAGIC = 0x46434D4D;  // "MMCF" little-endian
+RuntimeConfig runtimeConfig;     // Config attiva in questo wake (default se nessun blob valido)
 
 // ===== DISPLAY REFRESH MANAGEMENT =====
 int partialRefreshCount = 0;
 unsigned long lastFullRefresh = 0;
 bool displayDirty = false;
 
+// Cosa mostra il pannello e-ink (l'immagine resta anche in deep sleep)
+// In RTC memory: sopravvive al deep sleep, torna PANEL_UNKNOWN a reset/accensione
+// PANEL_OTHER_IMAGE: immagine della playlist SD, da conservare ma diversa dallo slot
+enum PanelContent { PANEL_UNKNOWN, PANEL_ACTIVE_IMAGE, PANEL_PREVIEW, PANEL_OTHER_IMAGE };
+RTC_DATA_ATTR int panelContent = PANEL_UNKNOWN;
+
+// ===== POWER MANAGEMENT =====
+
+/**
+ * Configura DFS + light sleep automatico
+ * I lock vengono tenuti di default (display e decode JPEG a piena velocità)
+ * e rilasciati solo durante le attese di rete: tra un pacchetto e l'altro
+ * la CPU va in light sleep con il modem in power-save. Il light sleep richiede
+ * il tickless idle nel core (assente nel core Arduino standard): senza, solo DFS
+ */
+void initPowerManagement() {
+#if ESP_IDF_VERSION_MAJOR >= 5
+  esp_pm_config_t pmConfig = {};
+#elif CONFIG_IDF_TARGET_ESP32S3
+  esp_pm_config_esp32s3_t pmConfig = {};
+#else
+  esp_pm_config_esp32_t pmConfig = {};
+#endif
+  pmConfig.max_freq_mhz = CPU_MAX_FREQ_MHZ;
+  pmConfig.min_freq_mhz = CPU_MIN_FREQ_MHZ;
+  pmConfig.light_sleep_enable = ENABLE_LIGHT_SLEEP;
+
+  esp_err_t err = esp_pm_configure(&pmConfig);
+  if (err != ESP_OK && pmConfig.light_sleep_enable) {
+    // Core senza tickless idle: ripiega su solo DFS
+    pmConfig.light_sleep_enable = false;
+    err = esp_pm_configure(&pmConfig);
+  }
+
+  if (err != ESP_OK) {
+    Serial.printf("Power management not available (%d)\n", err);
+    return;
+  }
+
+  esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "mmpaper_cpu", &pmCpuLock);
+  esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "mmpaper_sleep", &pmSleepLock);
+  if (pmCpuLock != nullptr) esp_pm_lock_acquire(pmCpuLock);
+  if (pmSleepLock != nullptr) esp_pm_lock_acquire(pmSleepLock);
+
+  Serial.printf("Power management: DFS %d-%d MHz, light sleep %s\n",
+                CPU_MIN_FREQ_MHZ, CPU_MAX_FREQ_MHZ,
+                pmConfig.light_sleep_enable ? "on" : "off");
+}
+
+/**
+ * Permette (o vieta) DFS + light sleep durante un'attesa
+ */
+void allowIdleSleep(bool allow) {
+  if (allow == pmIdleAllowed) return;
+  pmIdleAllowed = allow;
+
+  if (allow) {
+    if (pmSleepLock != nullptr) esp_pm_lock_release(pmSleepLock);
+    if (pmCpuLock != nullptr) esp_pm_lock_release(pmCpuLock);
+  } else {
+    if (pmCpuLock != nullptr) esp_pm_lock_acquire(pmCpuLock);
+    if (pmSleepLock != nullptr) esp_pm_lock_acquire(pmSleepLock);
+  }
+}
+
+/**
+ * Attesa a basso consumo (sostituisce delay() nelle pause di rete)
+ */
+void idleWait(uint32_t ms) {
+  allowIdleSleep(true);
+  vTaskDelay(pdMS_TO_TICKS(ms));
+  allowIdleSleep(false);
+}
+
 // ===== WIFI CONNECTION =====
 
+/**
+ * Handler eventi WiFi: sveglia connectToWiFi() invece del polling
+ */
+void onWiFiEvent(WiFiEvent_t event, WiFiEventInfo_t info) {
+  if (event == ARDUINO_EVENT_WIFI_STA_GOT_IP) {
+    xEventGroupSetBits(netEvents, EVT_WIFI_CONNECTED);
+  } else if (event == ARDUINO_EVENT_WIFI_STA_DISCONNECTED &&
+             info.wifi_sta_disconnected.reason == WIFI_REASON_NO_AP_FOUND) {
+    // Altri motivi (es. auth fallita al primo tentativo) possono ancora
+    // risolversi con l'auto-reconnect: per quelli si aspetta il timeout
+    xEventGroupSetBits(netEvents, EVT_WIFI_FAILED);
+  }
+}
+
+/**
+ * Callback SNTP: ora sincronizzata
+ */
+void onTimeSynced(struct timeval* tv) {
+  xEventGroupSetBits(netEvents, EVT_TIME_SYNCED);
+}
+
+/**
+ * Crea event group e registra gli handler (una volta sola)
+ */
+void initNetworkEvents() {
+  if (netEvents != nullptr) return;
+  netEvents = xEventGroupCreate();
+  WiFi.onEvent(onWiFiEvent);
+  sntp_set_time_sync_notification_cb(onTimeSynced);
+}
+
+/**
+ * Avvia una richiesta HTTP(S) con un client di cui conosciamo il socket
+ * HTTP/1.0: il server non può usare chunked, lo stream contiene solo il body
+ * acceptCompressed: chiede gzip/deflate (il body va letto con httpBodyRead)
+ */
+void httpBegin(HTTPClient& http, const String& url, bool acceptCompressed = true) {
+  httpUsingTLS = url.startsWith("https://");
+  if (httpUsingTLS) {
+    tlsClient.setInsecure();  // Come prima: nessuna verifica certificato
+    http.begin(tlsClient, url);
+  } else {
+    http.begin(tcpClient, url);
+  }
+
+  http.useHTTP10(true);
+  if (ENABLE_HTTP_COMPRESSION && acceptCompressed) {
+    http.addHeader("Accept-Encoding", "gzip, deflate");
+  }
+  const char* headerKeys[] = { "Content-Encoding", "Content-Range" };
+  http.collectHeaders(headerKeys, 2);
+}
+
+/**
+ * Attende dati sulla connessione HTTP senza polling (select con timeout)
+ * Durante l'attesa la CPU può andare in light sleep
+ * Returns: byte disponibili, 0 se timeout o connessione chiusa
+ */
+size_t waitForStreamData(WiFiClient* stream, uint32_t timeoutMs) {
+  size_t available = stream->available();
+  if (available > 0) return available;
+
+  int fd = httpUsingTLS ? tlsClient.fd() : tcpClient.fd();
+  if (fd < 0) return 0;
+
+  fd_set readSet;
+  FD_ZERO(&readSet);
+  FD_SET(fd, &readSet);
+
+  // Un record TLS può arrivare in più pacchetti: riprova finché c'è tempo
+  unsigned long start = millis();
+  while (millis() - start < timeoutMs) {
+    uint32_t remaining = timeoutMs - (millis() - start);
+    struct timeval tv;
+    tv.tv_sec = remaining / 1000;
+    tv.tv_usec = (remaining % 1000) * 1000;
+
+    allowIdleSleep(true);
+    int ready = select(fd + 1, &readSet, nullptr, nullptr, &tv);
+    allowIdleSleep(false);
+
+    if (ready <= 0) return 0;  // Timeout o errore
+
+    available = stream->available();
+    if (available > 0) return available;
+    if (!stream->connected()) return 0;  // Chiusura dal server
+
+    FD_ZERO(&readSet);
+    FD_SET(fd, &readSet);
+  }
+  return 0;
+}
+
 /**
  * Connette al WiFi provando tutte le reti disponibili
  * - Prova tutte le reti in sequenza
@@ -31,33 +311,41 @@ bool displayDirty = false;
  * Returns: true se connesso, false se tutti i tentativi falliscono
  */
 bool connectToWiFi() {
+  if (!radioAllowed) {
+    Serial.println("WiFi not allowed on button wake");
+    return false;
+  }
+
   Serial.println("=== CONNECTING TO WIFI ===");
 
+  initNetworkEvents();
   WiFi.mode(WIFI_STA);
+  WiFi.setSleep(WIFI_PS_MIN_MODEM);  // Modem sleep tra un beacon e l'altro
   WiFi.disconnect();
-  delay(100);
 
   // Loop per numero massimo di tentativi
   for (int attempt = 1; attempt <= WIFI_MAX_ATTEMPTS; attempt++) {
     Serial.printf("Attempt %d/%d\n", attempt, WIFI_MAX_ATTEMPTS);
 
-    // Prova tutte le reti disponibili
-    for (int i = 0; i < WIFI_NETWORKS_COUNT; i++) {
-      const char* ssid = WIFI_NETWORKS[i].ssid;
-      const char* password = WIFI_NETWORKS[i].password;
+    // Prova tutte le reti disponibili: prima quelle della runtime config, poi config.h
+    int networkCount = runtimeConfig.wifiCount + WIFI_NETWORKS_COUNT;
+    for (int i = 0; i < networkCount; i++) {
+      bool runtimeNet = i < runtimeConfig.wifiCount;
+      const char* ssid = runtimeNet ? runtimeConfig.wifi[i].ssid
+                                    : WIFI_NETWORKS[i - runtimeConfig.wifiCount].ssid;
+      const char* password = runtimeNet ? runtimeConfig.wifi[i].password
+                                        : WIFI_NETWORKS[i - runtimeConfig.wifiCount].password;
 
-      Serial.printf("Trying network %d/%d: %s\n", i + 1, WIFI_NETWORKS_COUNT, ssid);
+      Serial.printf("Trying network %d/%d: %s\n", i + 1, networkCount, ssid);
 
+      xEventGroupClearBits(netEvents, EVT_WIFI_CONNECTED | EVT_WIFI_FAILED);
       WiFi.begin(ssid, password);
 
-      // Aspetta connessione (timeout per singola rete)
-      unsigned long startAttempt = millis();
-      while (WiFi.status() != WL_CONNECTED &&
-             millis() - startAttempt < WIFI_CONNECT_TIMEOUT_PER_NET) {
-        delay(100);
-        Serial.print(".");
-      }
-      Serial.println();
+      // Aspetta evento GOT_IP (timeout per singola rete)
+      allowIdleSleep(true);
+      xEventGroupWaitBits(netEvents, EVT_WIFI_CONNECTED | EVT_WIFI_FAILED,
+                          pdFALSE, pdFALSE, pdMS_TO_TICKS(WIFI_CONNECT_TIMEOUT_PER_NET));
+      allowIdleSleep(false);
 
       // Connessione riuscita?
       if (WiFi.status() == WL_CONNECTED) {
@@ -69,13 +357,13 @@ bool connectToWiFi() {
 
       Serial.printf("❌ Failed to connect to: %s\n", ssid);
       WiFi.disconnect();
-      delay(500);  // Breve pausa tra una rete e l'altra
+      idleWait(500);  // Breve pausa tra una rete e l'altra
     }
 
     // Se non è l'ultimo tentativo, aspetta prima di riprovare
     if (attempt < WIFI_MAX_ATTEMPTS) {
       Serial.printf("Waiting %d seconds before retry...\n", WIFI_RETRY_DELAY / 1000);
-      delay(WIFI_RETRY_DELAY);
+      idleWait(WIFI_RETRY_DELAY);
     }
   }
 
@@ -85,6 +373,264 @@ bool connectToWiFi() {
   return false;
 }
 
+// ===== HTTP BODY (GZIP/DEFLATE) =====
+
+/**
+ * Legge un uint32 little-endian (header layered/tile, trailer gzip)
+ */
+uint32_t readLE32(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/**
+ * Legge un uint16 little-endian (indice immagini a tile)
+ */
+uint16_t readLE16(const uint8_t* p) {
+  return (uint16_t)p[0] | ((uint16_t)p[1] << 8);
+}
+
+/**
+ * Riempie il buffer di input compresso dallo stream
+ * Returns: false a fine body o su timeout
+ */
+bool httpBodyFill(HttpBody& body) {
+  if (body.remaining == 0) return false;
+
+  size_t available = waitForStreamData(body.stream, NET_READ_TIMEOUT);
+  if (available == 0) return false;
+
+  size_t n = min(available, (size_t)HTTP_INPUT_CHUNK);
+  if (body.remaining > 0) n = min(n, (size_t)body.remaining);
+
+  int got = body.stream->read(body.in, n);
+  if (got <= 0) return false;
+
+  if (body.remaining > 0) body.remaining -= got;
+  body.inPos = 0;
+  body.inLen = got;
+  return true;
+}
+
+/**
+ * Legge un byte di input compresso
+ * Returns: byte, -1 a fine body o su timeout
+ */
+int httpBodyInputByte(HttpBody& body) {
+  if (body.inPos == body.inLen && !httpBodyFill(body)) return -1;
+  return body.in[body.inPos++];
+}
+
+/**
+ * Salta l'header gzip (RFC 1952): resta il deflate raw
+ */
+bool httpBodySkipGzipHeader(HttpBody& body) {
+  int hdr[10];
+  for (int i = 0; i < 10; i++) {
+    if ((hdr[i] = httpBodyInputByte(body)) < 0) return false;
+  }
+  if (hdr[0] != 0x1F || hdr[1] != 0x8B || hdr[2] != 8) return false;
+
+  int flags = hdr[3];
+  if (flags & 0x04) {  // FEXTRA
+    int lo = httpBodyInputByte(body);
+    int hi = httpBodyInputByte(body);
+    if (lo < 0 || hi < 0) return false;
+    for (int i = 0; i < (lo | (hi << 8)); i++) {
+      if (httpBodyInputByte(body) < 0) return false;
+    }
+  }
+  for (int field = 0x08; field <= 0x10; field <<= 1) {  // FNAME, FCOMMENT
+    if (!(flags & field)) continue;
+    int c;
+    while ((c = httpBodyInputByte(body)) > 0) {}
+    if (c < 0) return false;
+  }
+  if (flags & 0x02) {  // FHCRC
+    if (httpBodyInputByte(body) < 0 || httpBodyInputByte(body) < 0) return false;
+  }
+  return true;
+}
+
+/**
+ * Libera i buffer di decompressione
+ */
+void httpBodyEnd(HttpBody& body) {
+  free(body.inflator);
+  free(body.window);
+  free(body.in);
+  body.inflator = nullptr;
+  body.window = nullptr;
+  body.in = nullptr;
+}
+
+/**
+ * Prepara la lettura del body in base a Content-Encoding
+ * Richiede httpBegin() (header raccolti) e GET() già eseguito
+ * Returns: false se encoding non supportato o memoria insufficiente
+ */
+bool httpBodyBegin(HttpBody& body, HTTPClient& http) {
+  memset(&body, 0, sizeof(body));
+  body.stream = http.getStreamPtr();
+  body.remaining = http.getSize();
+
+  String encoding = http.header("Content-Encoding");
+  encoding.toLowerCase();
+  if (encoding.length() == 0 || encoding == "identity") {
+    body.encoding = BODY_IDENTITY;
+    return true;
+  }
+  if (encoding != "gzip" && encoding != "deflate") {
+    Serial.printf("Unsupported Content-Encoding: %s\n", encoding.c_str());
+    return false;
+  }
+
+  body.encoding = (encoding == "gzip") ? BODY_GZIP : BODY_DEFLATE;
+  body.inflator = (tinfl_decompressor*)malloc(sizeof(tinfl_decompressor));
+  body.window = (uint8_t*)malloc(TINFL_LZ_DICT_SIZE);
+  body.in = (uint8_t*)malloc(HTTP_INPUT_CHUNK);
+  if (body.inflator == nullptr || body.window == nullptr || body.in == nullptr) {
+    Serial.println("Failed to allocate inflate buffers!");
+    httpBodyEnd(body);
+    return false;
+  }
+  tinfl_init(body.inflator);
+
+  if (body.encoding == BODY_GZIP) {
+    if (!httpBodySkipGzipHeader(body)) {
+      Serial.println("Invalid gzip header");
+      httpBodyEnd(body);
+      return false;
+    }
+  } else {
+    // "deflate" dovrebbe essere zlib (RFC 1950), alcuni server mandano deflate raw
+    if (body.inPos == body.inLen && !body.moreOutput && !httpBodyFill(body)) {
+      httpBodyEnd(body);
+      return false;
+    }
+    if ((body.in[body.inPos] & 0x0F) == 8) body.flags = TINFL_FLAG_PARSE_ZLIB_HEADER;
+  }
+
+  Serial.printf("Content-Encoding: %s\n", encoding.c_str());
+  return true;
+}
+
+/**
+ * Verifica il trailer gzip: CRC32 e dimensione dei dati decompressi
+ * Il tinfl della ROM (miniz 1.x) legge in anticipo nel bit buffer e non
+ * restituisce i byte: i primi byte del trailer possono essere già lì
+ */
+bool httpBodyCheckGzipTrailer(HttpBody& body) {
+  uint8_t trailer[8];
+  uint64_t bitBuf = body.inflator->m_bit_buf;
+  uint32_t numBits = body.inflator->m_num_bits;
+  bitBuf >>= numBits & 7;  // Padding fino al confine di byte dopo l'ultimo blocco
+  numBits -= numBits & 7;
+
+  int i = 0;
+  for (; i < 8 && numBits >= 8; i++) {
+    trailer[i] = bitBuf & 0xFF;
+    bitBuf >>= 8;
+    numBits -= 8;
+  }
+  for (; i < 8; i++) {
+    int c = httpBodyInputByte(body);
+    if (c < 0) return false;
+    trailer[i] = c;
+  }
+  return readLE32(trailer) == body.crc && readLE32(trailer + 4) == (uint32_t)body.total;
+}
+
+/**
+ * Legge fino a len byte (decompressi) dal body
+ * Returns: byte letti, 0 a fine body o su errore (vedi body.failed)
+ */
+size_t httpBodyRead(HttpBody& body, uint8_t* dest, size_t len) {
+  if (body.encoding == BODY_IDENTITY) {
+    if (body.remaining == 0) return 0;
+    size_t available = waitForStreamData(body.stream, NET_READ_TIMEOUT);
+    if (available == 0) return 0;
+
+    size_t n = min(available, len);
+    if (body.remaining > 0) n = min(n, (size_t)body.remaining);
+    int got = body.stream->read(dest, n);
+    if (got <= 0) return 0;
+    if (body.remaining > 0) body.remaining -= got;
+    body.total += got;
+    return got;
+  }
+
+  size_t out = 0;
+  while (out < len && !body.failed) {
+    // 1. Consegna l'output già decompresso (è nella finestra circolare)
+    if (body.pendingLen > 0) {
+      size_t n = min(body.pendingLen, len - out);
+      memcpy(dest + out, body.window + body.pendingPos, n);
+      if (body.encoding == BODY_GZIP) body.crc = esp_rom_crc32_le(body.crc, dest + out, n);
+      body.pendingPos += n;
+      body.pendingLen -= n;
+      body.total += n;
+      out += n;
+      continue;
+    }
+
+    if (body.finished) {
+      if (body.encoding == BODY_GZIP && !body.trailerChecked) {
+        body.trailerChecked = true;
+        if (!httpBodyCheckGzipTrailer(body)) {
+          Serial.println("gzip CRC/size mismatch");
+          body.failed = true;
+        }
+      }
+      break;
+    }
+
+    // 2. Decomprime: l'output va nella finestra da TINFL_LZ_DICT_SIZE (che fa da dizionario)
+    if (body.inPos == body.inLen && !body.moreOutput && !httpBodyFill(body)) {
+      Serial.println("Compressed stream ended early");
+      body.failed = true;
+      break;
+    }
+
+    size_t inSize = body.inLen - body.inPos;
+    size_t outSize = TINFL_LZ_DICT_SIZE - body.windowPos;
+    tinfl_status status = tinfl_decompress(body.inflator, body.in + body.inPos, &inSize,
+                                           body.window, body.window + body.windowPos, &outSize,
+                                           body.flags | TINFL_FLAG_HAS_MORE_INPUT);
+    body.inPos += inSize;
+    body.pendingPos = body.windowPos;
+    body.pendingLen = outSize;
+    body.windowPos = (body.windowPos + outSize) & (TINFL_LZ_DICT_SIZE - 1);
+    body.moreOutput = (status == TINFL_STATUS_HAS_MORE_OUTPUT);
+
+    if (status == TINFL_STATUS_DONE) {
+      body.finished = true;
+    } else if (status < 0) {
+      Serial.printf("Inflate error: %d\n", (int)status);
+      body.failed = true;
+    }
+  }
+  return out;
+}
+
+/**
+ * Legge tutto il body come stringa (metadata JSON), decompresso se serve
+ */
+String httpGetString(HTTPClient& http) {
+  HttpBody body;
+  if (!httpBodyBegin(body, http)) return "";
+
+  String payload;
+  uint8_t buf[257];
+  size_t n;
+  while ((n = httpBodyRead(body, buf, sizeof(buf) - 1)) > 0) {
+    buf[n] = 0;
+    payload += (const char*)buf;
+  }
+
+  httpBodyEnd(body);
+  return body.failed ? "" : payload;
+}
+
 // ===== AUTO-UPDATE FUNCTIONS =====
 
 /**
@@ -99,9 +645,59 @@ bool shouldCheckFirmwareUpdate() {
   return false;
 }
 
+/**
+ * ID del device nel manifest: ultimi 3 byte del MAC in hex (es. "a0b1c2")
+ */
+String deviceId() {
+  uint64_t mac = ESP.getEfuseMac();  // Byte del MAC in ordine little-endian
+  char id[7];
+  snprintf(id, sizeof(id), "%02x%02x%02x", (int)((mac >> 24) & 0xFF),
+           (int)((mac >> 32) & 0xFF), (int)((mac >> 40) & 0xFF));
+  return String(id);
+}
+
+/**
+ * Slot di check del device: secondi dopo l'ora di check
+ * Hash FNV-1a del MAC modulo la finestra: stabile per device, sparso sulla flotta
+ */
+int fetchSlotOffset() {
+  prefs.begin("mmconfig", true);
+  int windowMin = prefs.getInt("fetchWindow", runtimeConfig.fetchWindowMinutes);
+  prefs.end();
+  if (windowMin <= 0) return 0;
+
+  uint64_t mac = ESP.getEfuseMac();
+  uint32_t hash = 2166136261u;
+  for (int i = 0; i < 6; i++) {
+    hash ^= (mac >> (8 * i)) & 0xFF;
+    hash *= 16777619u;
+  }
+  return hash % (windowMin * 60);
+}
+
+/**
+ * Jitter massimo (secondi): runtime config o valore dal manifest
+ */
+int fetchJitterSeconds() {
+  prefs.begin("mmconfig", true);
+  int jitter = prefs.getInt("fetchJitter", runtimeConfig.fetchJitterSeconds);
+  prefs.end();
+  return jitter;
+}
+
+/**
+ * Differenza now - slot in secondi sul giorno circolare, in [-12h, +12h)
+ */
+int secondsFromSlot(int nowSec, int slotSec) {
+  int diff = (nowSec - slotSec) % 86400;
+  if (diff < -43200) diff += 86400;
+  if (diff >= 43200) diff -= 86400;
+  return diff;
+}
+
 /**
  * Controlla se è il momento di verificare aggiornamenti immagine
- * Trigger: 6:00, 9:00, 12:00, 15:00, 18:00, 21:00, 00:00
+ * Trigger: slot del device dopo ogni ora di check (runtime config, default IMAGE_CHECK_HOURS)
  */
 bool shouldCheckImageUpdate() {
   // Al primo avvio: sempre
@@ -117,267 +713,1670 @@ bool shouldCheckImageUpdate() {
     return false;
   }
 
-  int currentHour = timeinfo.tm_hour;
-  int currentMin = timeinfo.tm_min;
-
-  // Orari di check
-  const int checkHours[] = IMAGE_CHECK_HOURS;
-  const int numCheckHours = sizeof(checkHours) / sizeof(checkHours[0]);
+  int nowSec = timeinfo.tm_hour * 3600 + timeinfo.tm_min * 60 + timeinfo.tm_sec;
+  int offset = fetchSlotOffset();
+  int tolerance = FETCH_SLOT_TOLERANCE + fetchJitterSeconds();
 
-  // Verifica se siamo in un orario di check (finestra di 5 minuti)
-  for (int i = 0; i < numCheckHours; i++) {
-    if (currentHour == checkHours[i] && currentMin < 5) {
+  // Verifica se siamo nello slot di un orario di check (1 min di anticipo per drift RTC)
+  for (int hour = 0; hour < 24; hour++) {
+    if (!(runtimeConfig.checkHours & (1UL << hour))) continue;
+    int diff = secondsFromSlot(nowSec, hour * 3600 + offset);
+    if (diff >= -60 && diff < tolerance) {
       // Verifica se non abbiamo già fatto check in questa ora
       prefs.begin("mmconfig", false);
-      int lastCheckHour = prefs.getInt("lastImageCheckHour", -1);
-      int lastCheckDay = prefs.getInt("lastImageCheckDay", -1);
+      int lastCheckHour = prefs.getInt("lastCheckHour", -1);
+      int lastCheckDay = prefs.getInt("lastCheckDay", -1);
       int currentDay = timeinfo.tm_mday;
       prefs.end();
 
       // Check necessario se: nuovo giorno O nuova ora
-      if (currentDay != lastCheckDay || currentHour != lastCheckHour) {
-        Serial.printf("Image check time reached: %02d:00\n", currentHour);
+      if (currentDay != lastCheckDay || hour != lastCheckHour) {
+        Serial.printf("Image check time reached: %02d:00 + %ds (slot)\n", hour, offset);
 
         // Salva orario check
         prefs.begin("mmconfig", false);
-        prefs.putInt("lastImageCheckHour", currentHour);
-        prefs.putInt("lastImageCheckDay", currentDay);
+        prefs.putInt("lastCheckHour", hour);
+        prefs.putInt("lastCheckDay", currentDay);
         prefs.end();
 
-        return true;
-      }
-    }
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+/**
+ * Verifica batteria sufficiente per update
+ */
+bool isBatteryOkForUpdate() {
+  int batteryLevel = M5.Power.getBatteryLevel();
+  return (batteryLevel >= runtimeConfig.minBatteryPercent);
+}
+
+/**
+ * Scrive un offset TZ POSIX ("+h:mm:ss", positivo = a ovest di UTC)
+ */
+void formatTzOffset(char* out, size_t len, long offset) {
+  long a = labs(offset);
+  snprintf(out, len, "%c%ld:%02ld:%02ld", offset < 0 ? '-' : '+', a / 3600, (a / 60) % 60, a % 60);
+}
+
+/**
+ * Imposta il fuso orario locale da GMT_OFFSET_SEC / DAYLIGHT_OFFSET_SEC, senza rete
+ * TZ non sopravvive al deep sleep e configTime() viene chiamata solo con il WiFi:
+ * senza questo il percorso da pulsante calcolerebbe gli slot di check in UTC
+ */
+void setLocalTimezone() {
+  char stdOffset[16], dstOffset[16], tz[48];
+  formatTzOffset(stdOffset, sizeof(stdOffset), -(long)GMT_OFFSET_SEC);
+  formatTzOffset(dstOffset, sizeof(dstOffset), -(long)(GMT_OFFSET_SEC + DAYLIGHT_OFFSET_SEC));
+  snprintf(tz, sizeof(tz), "UTC%sDST%s", stdOffset, dstOffset);  // Come configTime()
+  setenv("TZ", tz, 1);
+  tzset();
+}
+
+/**
+ * Sincronizza ora via NTP (richiede WiFi connesso)
+ * Se l'RTC ha già un'ora valida (wake da deep sleep) la sync prosegue in
+ * background; altrimenti attende la callback SNTP (max NTP_SYNC_TIMEOUT)
+ */
+void syncTimeFromNTP() {
+  Serial.println("Syncing time from NTP...");
+  initNetworkEvents();
+  xEventGroupClearBits(netEvents, EVT_TIME_SYNCED);
+  configTime(GMT_OFFSET_SEC, DAYLIGHT_OFFSET_SEC, NTP_SERVER);
+
+  struct tm timeinfo;
+  if (!getLocalTime(&timeinfo, 0)) {
+    allowIdleSleep(true);
+    xEventGroupWaitBits(netEvents, EVT_TIME_SYNCED, pdFALSE, pdFALSE,
+                        pdMS_TO_TICKS(NTP_SYNC_TIMEOUT));
+    allowIdleSleep(false);
+  }
+
+  if (getLocalTime(&timeinfo, 0)) {
+    Serial.printf("Time synced: %04d-%02d-%02d %02d:%02d:%02d\n",
+                  timeinfo.tm_year + 1900, timeinfo.tm_mon + 1, timeinfo.tm_mday,
+                  timeinfo.tm_hour, timeinfo.tm_min, timeinfo.tm_sec);
+    return;
+  }
+  Serial.println("NTP sync timeout");
+}
+
+/**
+ * Estrae il valore stringa di una chiave da un JSON semplice
+ * Tollera spazi dopo i ":" (come nei file generati dagli script)
+ * Returns: valore, o stringa vuota se la chiave non esiste
+ */
+String jsonStringValue(const String& json, const char* key, int from = 0) {
+  int keyPos = json.indexOf("\"" + String(key) + "\"", from);
+  if (keyPos < 0) return "";
+
+  int colon = json.indexOf(':', keyPos + strlen(key) + 2);  // La chiave può contenere ":"
+  int valueStart = json.indexOf('"', colon + 1);
+  if (colon < 0 || valueStart < 0) return "";
+
+  int valueEnd = json.indexOf('"', valueStart + 1);
+  if (valueEnd < 0) return "";
+
+  return json.substring(valueStart + 1, valueEnd);
+}
+
+/**
+ * Estrae il valore intero di una chiave da un JSON semplice
+ * Returns: valore, o defaultValue se la chiave non esiste o non è un numero
+ */
+int jsonIntValue(const String& json, const char* key, int defaultValue) {
+  int keyPos = json.indexOf("\"" + String(key) + "\"");
+  if (keyPos < 0) return defaultValue;
+
+  int pos = json.indexOf(':', keyPos + strlen(key) + 2) + 1;
+  if (pos <= 0) return defaultValue;
+  while (pos < (int)json.length() && json[pos] == ' ') pos++;
+
+  if (pos >= (int)json.length() || !(isdigit(json[pos]) || json[pos] == '-')) return defaultValue;
+  return json.substring(pos).toInt();
+}
+
+/**
+ * Mostra messaggio su display e-ink
+ */
+void displayMessage(const char* message, int y = 270) {
+  M5.Display.setFont(&fonts::FreeSans18pt7b);
+  M5.Display.setTextDatum(middle_center);
+  M5.Display.setTextColor(TFT_BLACK, TFT_WHITE);
+  M5.Display.fillScreen(TFT_WHITE);
+  M5.Display.drawString(message, 480, y);
+  M5.Display.display();  // Full refresh
+  panelContent = PANEL_UNKNOWN;
+  // Non spegniamo display qui perché potrebbero esserci più messaggi in sequenza
+}
+
+// ===== IMAGE FUNCTIONS =====
+
+/**
+ * Costruisce URL completo di un file sul content server
+ */
+String contentURL(const char* path) {
+  const char* base = runtimeConfig.baseUrl[0] != 0 ? runtimeConfig.baseUrl : CONTENT_BASE_URL;
+  return String(base) + "/" + path;
+}
+
+/**
+ * URL di un file immagine nella cartella del device (image/ o target del manifest)
+ */
+String imageURL(const char* file) {
+  if (imageDir.length() == 0) {
+    prefs.begin("mmconfig", true);
+    imageDir = prefs.getString("imageDir", "image");
+    prefs.end();
+  }
+  return contentURL((imageDir + "/" + file).c_str());
+}
+
+/**
+ * Disegna un JPEG a schermo intero nel framebuffer (senza refresh)
+ * Smart crop: scala per riempire mantenendo aspect ratio, croppa dal centro
+ * Funziona anche con anteprime a bassa risoluzione (scala > 1)
+ * Returns: false se il JPEG non è valido o il decode fallisce
+ */
+bool drawJpegFill(const uint8_t* data, size_t size) {
+  // Get JPEG dimensions using TJpgDec parser
+  lgfxJdec jdec;
+  uint8_t workbuf[3100];  // Working buffer for TJpgDec
+
+  // JPEG data source for parser
+  struct JpgDataSource {
+    const uint8_t* buffer;
+    size_t size;
+    size_t pos;
+  };
+
+  // Data read callback
+  auto jpgRead = [](void* data, uint8_t* buf, uint32_t len) -> uint32_t {
+    JpgDataSource* src = (JpgDataSource*)data;
+    if (src->pos >= src->size) return 0;
+    uint32_t remain = src->size - src->pos;
+    if (len > remain) len = remain;
+    memcpy(buf, src->buffer + src->pos, len);
+    src->pos += len;
+    return len;
+  };
+
+  JpgDataSource jpgData = { data, size, 0 };
+
+  // Parse JPEG header to get dimensions
+  JRESULT res = lgfx_jd_prepare(&jdec, jpgRead, workbuf, sizeof(workbuf), &jpgData);
+
+  if (res != JDR_OK) {
+    Serial.printf("Failed to parse JPEG: %d\n", res);
+    return false;
+  }
+
+  int jpgWidth = jdec.width;
+  int jpgHeight = jdec.height;
+
+  Serial.printf("Image dimensions: %dx%d\n", jpgWidth, jpgHeight);
+
+  // PORTRAIT MODE: 540×960 (9:16 aspect ratio)
+  const int SCREEN_WIDTH = 540;
+  const int SCREEN_HEIGHT = 960;
+
+  // Calcola aspect ratio
+  float imgRatio = (float)jpgWidth / (float)jpgHeight;
+  float screenRatio = (float)SCREEN_WIDTH / (float)SCREEN_HEIGHT;  // 9:16 = 0.5625
+
+  int drawX = 0, drawY = 0;
+  int drawWidth = SCREEN_WIDTH, drawHeight = SCREEN_HEIGHT;
+  float scale;
+
+  // Smart crop: scala per riempire, poi offset per centrare
+  if (imgRatio > screenRatio) {
+    // Immagine più larga: scala in base all'altezza, croppa i lati
+    scale = (float)SCREEN_HEIGHT / (float)jpgHeight;
+    drawHeight = SCREEN_HEIGHT;
+    drawWidth = (int)((float)jpgWidth * scale);
+    drawX = -(drawWidth - SCREEN_WIDTH) / 2;  // Centra orizzontalmente
+    Serial.printf("Wide image: crop sides (draw at x=%d, width=%d)\n", drawX, drawWidth);
+  } else {
+    // Immagine più alta: scala in base alla larghezza, croppa top/bottom
+    scale = (float)SCREEN_WIDTH / (float)jpgWidth;
+    drawWidth = SCREEN_WIDTH;
+    drawHeight = (int)((float)jpgHeight * scale);
+    drawY = -(drawHeight - SCREEN_HEIGHT) / 2;  // Centra verticalmente
+    Serial.printf("Tall image: crop top/bottom (draw at y=%d, height=%d)\n", drawY, drawHeight);
+  }
+
+  // Disegna con dimensioni calcolate (overflow viene clippato automaticamente)
+  M5.Display.fillScreen(TFT_BLACK);
+  if (!M5.Display.drawJpg(data, size, drawX, drawY, drawWidth, drawHeight, 0, 0, scale, scale)) {
+    Serial.println("JPEG decode failed");
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Voce dell'indice di un'immagine a tile
+ */
+struct TileEntry {
+  uint16_t x, y, w, h;   // Area sul pannello (portrait 540×960)
+  uint32_t offset;       // Posizione del JPEG nel file
+  uint32_t size;         // Byte JPEG
+  const uint8_t* md5;    // MD5 raw (16 byte, punta nell'indice)
+};
+
+/**
+ * Controlla se il buffer è un contenitore a tile con indice completo
+ * Returns: numero di tile, 0 se non è un contenitore valido
+ */
+int tiledImageCount(const uint8_t* data, size_t size) {
+  if (data == nullptr || size < TILED_HEADER_SIZE || memcmp(data, TILED_IMAGE_MAGIC, 4) != 0) {
+    return 0;
+  }
+  int count = readLE16(data + 4);
+  if (count == 0 || count > TILED_MAX_TILES ||
+      size < (size_t)TILED_HEADER_SIZE + count * TILED_ENTRY_SIZE) {
+    return 0;
+  }
+  return count;
+}
+
+/**
+ * Legge la voce i dell'indice
+ */
+TileEntry tileEntryAt(const uint8_t* data, int i) {
+  const uint8_t* p = data + TILED_HEADER_SIZE + i * TILED_ENTRY_SIZE;
+  TileEntry tile = { readLE16(p), readLE16(p + 2), readLE16(p + 4), readLE16(p + 6),
+                     readLE32(p + 8), readLE32(p + 12), p + 16 };
+  return tile;
+}
+
+/**
+ * Disegna tutte le tile nel framebuffer (senza refresh, scala 1:1)
+ * Returns: false se l'indice punta fuori dal file o un decode fallisce
+ */
+bool drawTiledImage(const uint8_t* data, size_t size) {
+  int count = tiledImageCount(data, size);
+
+  for (int i = 0; i < count; i++) {
+    TileEntry tile = tileEntryAt(data, i);
+    if ((uint64_t)tile.offset + tile.size > size) {
+      Serial.printf("Tile %d out of bounds\n", i);
+      return false;
+    }
+  }
+
+  Serial.printf("Tiled image: %d tiles\n", count);
+  for (int i = 0; i < count; i++) {
+    TileEntry tile = tileEntryAt(data, i);
+    if (!M5.Display.drawJpg(data + tile.offset, tile.size, tile.x, tile.y, tile.w, tile.h)) {
+      Serial.printf("Tile %d decode failed\n", i);
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * Refresh solo del rettangolo che contiene le tile cambiate (tileRefreshMask)
+ * Il resto del pannello e-ink mantiene l'immagine precedente
+ */
+void refreshChangedTiles(const uint8_t* data, size_t size) {
+  int count = tiledImageCount(data, size);
+  int left = 0xFFFF, top = 0xFFFF, right = 0, bottom = 0;
+
+  for (int i = 0; i < count; i++) {
+    if (!(tileRefreshMask & (1ULL << i))) continue;
+    TileEntry tile = tileEntryAt(data, i);
+    left = min(left, (int)tile.x);
+    top = min(top, (int)tile.y);
+    right = max(right, tile.x + tile.w);
+    bottom = max(bottom, tile.y + tile.h);
+  }
+
+  if (left >= right || top >= bottom) {
+    M5.Display.display();
+    return;
+  }
+
+  Serial.printf("Partial refresh: %d,%d %dx%d\n", left, top, right - left, bottom - top);
+  M5.Display.display(left, top, right - left, bottom - top);
+}
+
+/**
+ * Mostra l'anteprima layered con refresh veloce (epd_fast)
+ * Il display resta acceso: displayImageFullscreen() la rifinisce in qualità
+ */
+bool displayImagePreview(const uint8_t* data, size_t size) {
+  Serial.println("Displaying preview...");
+
+  M5.Display.wakeup();
+  M5.Display.setColorDepth(8);  // 8-bit grayscale
+  M5.Display.setEpdMode(epd_fast);
+
+  if (!drawJpegFill(data, size)) {
+    Serial.println("Invalid preview, skipping");
+    return false;
+  }
+
+  M5.Display.display();  // Refresh veloce, prosegue mentre scarichiamo il resto
+  previewDisplayed = true;
+  panelContent = PANEL_PREVIEW;
+  return true;
+}
+
+/**
+ * Mostra immagine JPEG a schermo intero (qualità piena)
+ * Smart crop: mantiene aspect ratio, riempie schermo, croppa dal centro
+ * Immagini a tile: tile 1:1, refresh solo dell'area in tileRefreshMask se il
+ * pannello mostra ancora l'immagine dello slot attivo (base del delta)
+ * mode: epd_fast per la navigazione da pulsante
+ * Returns: false se il decode fallisce (nessun refresh se c'è un rollback possibile)
+ */
+bool displayImageFullscreen(epd_mode_t mode = epd_quality) {
+  if (imageBuffer == nullptr || imageBufferSize == 0) {
+    Serial.println("No image to display!");
+    return false;
+  }
+
+  Serial.println("Displaying image fullscreen...");
+
+  M5.Display.wakeup();  // Sveglia display se in sleep
+  M5.Display.setColorDepth(8);  // 8-bit grayscale
+  M5.Display.setEpdMode(mode);  // epd_quality anche dopo un'anteprima epd_fast
+
+  bool tiled = tiledImageCount(imageBuffer, imageBufferSize) > 0;
+  bool drawn = tiled ? drawTiledImage(imageBuffer, imageBufferSize)
+                     : drawJpegFill(imageBuffer, imageBufferSize);
+  if (!drawn) {
+    tileRefreshMask = 0;
+    // Errore a schermo solo se non c'è niente di meglio da mostrare
+    // (anteprima già visibile o immagine buona nello slot attivo)
+    if (!previewDisplayed && activeImageSlot < 0) {
+      M5.Display.fillScreen(TFT_BLACK);
+      M5.Display.drawString("Invalid JPEG", 480, 270);
+      M5.Display.display();
+      panelContent = PANEL_UNKNOWN;
+    }
+    M5.Display.sleep();
+    return false;
+  }
+
+  if (tiled && tileRefreshMask != 0 && panelContent == PANEL_ACTIVE_IMAGE) {
+    refreshChangedTiles(imageBuffer, imageBufferSize);  // Solo l'area cambiata
+  } else {
+    M5.Display.display();  // Full refresh (messaggio o anteprima da coprire)
+  }
+  tileRefreshMask = 0;
+  panelContent = PANEL_ACTIVE_IMAGE;
+  M5.Display.sleep();    // Spegni display
+
+  Serial.println("Image displayed with smart crop!");
+  return true;
+}
+
+/**
+ * Formato immagine pubblicato (campo "format" di image_meta.json)
+ */
+enum ImageFormat {
+  IMAGE_JPEG,     // image/current.jpg
+  IMAGE_LAYERED,  // image/current.mmp (anteprima + JPEG completo)
+  IMAGE_TILED     // image/current.mmt (tile, aggiornabile via Range)
+};
+
+/**
+ * Metadata immagine remota (image/image_meta.json)
+ */
+struct ImageMeta {
+  String md5;          // MD5 del contenuto finale: JPEG completo o contenitore tile (vuoto se errore)
+  ImageFormat format;
+};
+
+/**
+ * Scarica un JSON piccolo (metadata, manifest)
+ * Returns: contenuto, stringa vuota se errore
+ */
+String downloadJSON(const String& url) {
+  HTTPClient http;
+
+  Serial.printf("Downloading metadata: %s\n", url.c_str());
+  httpBegin(http, url);
+  int httpCode = http.GET();
+
+  if (httpCode != HTTP_CODE_OK) {
+    Serial.printf("Metadata download failed: %d\n", httpCode);
+    http.end();
+    return "";
+  }
+
+  String payload = httpGetString(http);
+  http.end();
+  return payload;
+}
+
+/**
+ * Override del manifest (chiave jsonKey) salvato in NVS (prefsKey)
+ * Chiave assente o fuori limite: override rimosso, vale la runtime config
+ */
+void applyFetchOverride(const String& manifest, const char* jsonKey, const char* prefsKey, int maxValue) {
+  int value = jsonIntValue(manifest, jsonKey, -1);
+  if (value >= 0 && value <= maxValue) {
+    if (!prefs.isKey(prefsKey) || prefs.getInt(prefsKey, -1) != value) {
+      prefs.putInt(prefsKey, value);
+      Serial.printf("Manifest %s: %d\n", jsonKey, value);
+    }
+  } else if (prefs.isKey(prefsKey)) {
+    prefs.remove(prefsKey);
+    Serial.printf("Manifest %s removed, using runtime config\n", jsonKey);
+  }
+}
+
+/**
+ * Finestra e jitter di fetch dal manifest (sopra la runtime config)
+ */
+void applyFetchSchedule(const String& manifest) {
+  prefs.begin("mmconfig", false);
+  applyFetchOverride(manifest, "window_minutes", "fetchWindow", 60);
+  applyFetchOverride(manifest, "jitter_seconds", "fetchJitter", 3600);
+  prefs.end();
+}
+
+// ===== RUNTIME CONFIG =====
+
+/**
+ * Riempie la config con i default di config.h
+ */
+void runtimeConfigDefaults(RuntimeConfig& rc) {
+  memset(&rc, 0, sizeof(rc));
+  rc.magic = RUNTIME_CONFIG_MAGIC;
+  rc.version = RUNTIME_CONFIG_VERSION;
+  rc.size = sizeof(rc);
+
+  const int checkHours[] = IMAGE_CHECK_HOURS;
+  for (size_t i = 0; i < sizeof(checkHours) / sizeof(checkHours[0]); i++) {
+    rc.checkHours |= 1UL << checkHours[i];
+  }
+  rc.fullRefreshMinInterval = FULL_REFRESH_MIN_INTERVAL;
+  rc.fetchJitterSeconds = FETCH_JITTER_SECONDS;
+  rc.minBatteryPercent = MIN_BATTERY_PERCENT;
+  rc.previewOnlyBatteryPercent = PREVIEW_ONLY_BATTERY_PERCENT;
+  rc.fetchWindowMinutes = FETCH_WINDOW_MINUTES;
+  rc.partialRefreshMaxCount = PARTIAL_REFRESH_MAX_COUNT;
+  strlcpy(rc.deviceGroup, DEVICE_GROUP, sizeof(rc.deviceGroup));
+}
+
+/**
+ * Calcola CRC32 della config (escluso il campo crc)
+ */
+uint32_t runtimeConfigCRC(const RuntimeConfig& rc) {
+  return esp_rom_crc32_le(0, (const uint8_t*)&rc, offsetof(RuntimeConfig, crc));
+}
+
+/**
+ * Valida una config: header, CRC e valori nei limiti
+ * Un blob che passa qui non può lasciare il device senza check né rete
+ */
+bool runtimeConfigValid(const RuntimeConfig& rc) {
+  if (rc.magic != RUNTIME_CONFIG_MAGIC || rc.version != RUNTIME_CONFIG_VERSION ||
+      rc.size != sizeof(rc) || rc.crc != runtimeConfigCRC(rc)) {
+    return false;
+  }
+
+  // Stringhe terminate, base URL vuoto o http(s)
+  if (memchr(rc.baseUrl, 0, sizeof(rc.baseUrl)) == nullptr ||
+      memchr(rc.deviceGroup, 0, sizeof(rc.deviceGroup)) == nullptr ||
+      (rc.baseUrl[0] != 0 && strncmp(rc.baseUrl, "http", 4) != 0)) {
+    return false;
+  }
+  if (rc.wifiCount > RUNTIME_CONFIG_WIFI_MAX) return false;
+  for (int i = 0; i < rc.wifiCount; i++) {
+    if (memchr(rc.wifi[i].ssid, 0, sizeof(rc.wifi[i].ssid)) == nullptr ||
+        memchr(rc.wifi[i].password, 0, sizeof(rc.wifi[i].password)) == nullptr ||
+        rc.wifi[i].ssid[0] == 0) {
+      return false;
+    }
+  }
+
+  return rc.checkHours != 0 && rc.checkHours < (1UL << 24) &&
+         rc.minBatteryPercent <= 100 && rc.previewOnlyBatteryPercent <= 100 &&
+         rc.fetchWindowMinutes <= 60 && rc.fetchJitterSeconds <= 3600 &&
+         rc.partialRefreshMaxCount > 0 && rc.fullRefreshMinInterval <= 600000;
+}
+
+/**
+ * Carica la runtime config (una volta per wake, prima di tutto il resto)
+ * Una config "pending" scaricata al wake precedente diventa attiva qui
+ */
+void loadRuntimeConfig() {
+  runtimeConfigDefaults(runtimeConfig);
+  if (!ENABLE_RUNTIME_CONFIG) return;
+
+  RuntimeConfig rc;
+  prefs.begin("mmconfig", false);
+
+  if (prefs.getBytesLength("configPending") == sizeof(rc)) {
+    prefs.getBytes("configPending", &rc, sizeof(rc));
+    if (runtimeConfigValid(rc)) {
+      prefs.putBytes("config", &rc, sizeof(rc));
+      Serial.printf("Runtime config seq %u applied\n", (unsigned)rc.seq);
+    }
+    prefs.remove("configPending");
+  }
+
+  bool loaded = prefs.getBytesLength("config") == sizeof(rc) &&
+                prefs.getBytes("config", &rc, sizeof(rc)) == sizeof(rc) &&
+                runtimeConfigValid(rc);
+  prefs.end();
+
+  if (loaded) {
+    runtimeConfig = rc;
+    Serial.printf("Runtime config: seq %u\n", (unsigned)rc.seq);
+  } else {
+    Serial.println("Runtime config: compile-time defaults");
+  }
+}
+
+/**
+ * Scarica config.bin se il manifest annuncia un "config_seq" più nuovo
+ * Validata e salvata come pending: si applica al wake successivo, così un
+ * wake non cambia base URL o orari a metà
+ */
+void checkRuntimeConfig(const String& manifest) {
+  if (!ENABLE_RUNTIME_CONFIG) return;
+
+  int seq = jsonIntValue(manifest, "config_seq", -1);
+  if (seq <= 0 || (uint32_t)seq <= runtimeConfig.seq) return;
+
+  RuntimeConfig rc;
+  prefs.begin("mmconfig", true);
+  uint32_t pendingSeq = 0;
+  if (prefs.getBytesLength("configPending") == sizeof(rc) &&
+      prefs.getBytes("configPending", &rc, sizeof(rc)) == sizeof(rc)) {
+    pendingSeq = rc.seq;
+  }
+  int rejectedSeq = prefs.getInt("cfgRejectSeq", 0);
+  prefs.end();
+
+  if ((uint32_t)seq <= pendingSeq || seq == rejectedSeq) return;
+
+  String url = imageURL("config.bin");
+  Serial.printf("Downloading runtime config seq %d: %s\n", seq, url.c_str());
+
+  HTTPClient http;
+  httpBegin(http, url);
+  int httpCode = http.GET();
+  if (httpCode != HTTP_CODE_OK) {
+    Serial.printf("Runtime config download failed: %d\n", httpCode);
+    http.end();
+    return;
+  }
+
+  // Un byte in più del blob: file più lungo = formato sbagliato
+  HttpBody body;
+  size_t total = 0;
+  if (httpBodyBegin(body, http)) {
+    uint8_t extra;
+    size_t n;
+    while (total < sizeof(rc) &&
+           (n = httpBodyRead(body, (uint8_t*)&rc + total, sizeof(rc) - total)) > 0) {
+      total += n;
+    }
+    if (total == sizeof(rc) && httpBodyRead(body, &extra, 1) > 0) total++;
+    httpBodyEnd(body);
+  }
+  http.end();
+
+  if (total < sizeof(rc) || body.failed) {
+    Serial.println("Runtime config download incomplete");
+    return;
+  }
+
+  if (total != sizeof(rc) || !runtimeConfigValid(rc) || rc.seq != (uint32_t)seq) {
+    Serial.printf("Runtime config seq %d rejected (%u bytes)\n", seq, (unsigned)total);
+    prefs.begin("mmconfig", false);
+    prefs.putInt("cfgRejectSeq", seq);
+    prefs.end();
+    return;
+  }
+
+  prefs.begin("mmconfig", false);
+  prefs.putBytes("configPending", &rc, sizeof(rc));
+  prefs.end();
+  Serial.printf("Runtime config seq %d stored, applied at next wake\n", seq);
+}
+
+/**
+ * Esito del download metadata: con un base URL da runtime config che non
+ * risponde per RUNTIME_CONFIG_MAX_FAILS check di fila si torna ai default
+ * (il server di config.h può pubblicare una config corretta)
+ */
+void noteContentServerResult(bool ok) {
+  if (runtimeConfig.baseUrl[0] == 0) return;
+
+  prefs.begin("mmconfig", false);
+  int fails = ok ? 0 : prefs.getInt("configFails", 0) + 1;
+  if (fails != prefs.getInt("configFails", 0)) prefs.putInt("configFails", fails);
+
+  if (fails >= RUNTIME_CONFIG_MAX_FAILS) {
+    Serial.printf("Content server unreachable %d times, runtime config seq %u dropped\n",
+                  fails, (unsigned)runtimeConfig.seq);
+    prefs.putInt("cfgRejectSeq", runtimeConfig.seq);
+    prefs.remove("config");
+    prefs.remove("configFails");
+    runtimeConfigDefaults(runtimeConfig);
+  }
+  prefs.end();
+}
+
+/**
+ * Scarica metadata immagine da GitHub
+ * image/image_meta.json fa da manifest: se "targets" ha una cartella per questo
+ * device ("device:<id>") o per il suo gruppo ("group:<nome>"), i metadata e
+ * l'immagine (e l'eventuale config.bin) vengono da lì
+ * Returns: metadata remoti, md5 vuoto se errore
+ */
+ImageMeta downloadImageMetadata() {
+  ImageMeta meta = { "", IMAGE_JPEG };
+
+  String payload = downloadJSON(contentURL("image/image_meta.json"));
+  noteContentServerResult(payload.length() > 0);
+  if (payload.length() == 0) return meta;
+
+  applyFetchSchedule(payload);
+
+  // Contenuto dedicato al device o al gruppo
+  String dir = jsonStringValue(payload, ("device:" + deviceId()).c_str());
+  if (dir.length() == 0 && strlen(runtimeConfig.deviceGroup) > 0) {
+    dir = jsonStringValue(payload, (String("group:") + runtimeConfig.deviceGroup).c_str());
+  }
+  while (dir.endsWith("/")) dir.remove(dir.length() - 1);
+  if (dir.length() == 0) dir = "image";
+
+  // Salvata anche per i download fuori dal check (setup, passo 3)
+  prefs.begin("mmconfig", false);
+  if (prefs.getString("imageDir", "image") != dir) prefs.putString("imageDir", dir);
+  prefs.end();
+  imageDir = dir;
+
+  if (dir != "image") {
+    Serial.printf("Manifest target for device %s: %s\n", deviceId().c_str(), dir.c_str());
+    payload = downloadJSON(imageURL("image_meta.json"));
+    if (payload.length() == 0) return meta;
+  }
+
+  // Runtime config della stessa cartella dei contenuti (per device/gruppo)
+  checkRuntimeConfig(payload);
+
+  // Parse JSON per ottenere MD5 e formato
+  meta.md5 = jsonStringValue(payload, "md5");
+  String format = jsonStringValue(payload, "format");
+  if (format == "layered") meta.format = IMAGE_LAYERED;
+  // "md5" resta quello di current.jpg (firmware precedenti), il contenitore ha il suo
+  String tilesMD5 = jsonStringValue(payload, "tiles_md5");
+  if (format == "tiled" && tilesMD5.length() > 0) {
+    meta.format = IMAGE_TILED;
+    meta.md5 = tilesMD5;
+  }
+
+  Serial.printf("Remote image MD5: %s (%s)\n", meta.md5.c_str(),
+                format.length() > 0 ? format.c_str() : "jpeg");
+  return meta;
+}
+
+/**
+ * Alloca (o rialloca) il buffer immagine
+ * Returns: true se successo, false se memoria insufficiente
+ */
+bool allocImageBuffer(size_t size) {
+  if (imageBuffer != nullptr) {
+    free(imageBuffer);
+  }
+  imageBuffer = (uint8_t*)malloc(size);
+  imageBufferSize = 0;
+
+  if (imageBuffer == nullptr) {
+    Serial.println("Failed to allocate image buffer!");
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Legge len byte dal body HTTP (attesa su socket, niente busy loop)
+ * Returns: byte letti (meno di len se il download si blocca o la connessione cade)
+ */
+size_t readBodyBytes(HttpBody& body, uint8_t* dest, size_t len) {
+  size_t bytesRead = 0;
+
+  while (bytesRead < len) {
+    size_t chunk = httpBodyRead(body, dest + bytesRead, len - bytesRead);
+    if (chunk == 0) {
+      Serial.println("Download stalled or connection closed");
+      break;
+    }
+    bytesRead += chunk;
+
+    if (bytesRead % 51200 == 0) {  // Progress ogni 50KB
+      Serial.printf("Downloaded: %u / %u KB (%u%%)\n",
+                    (unsigned)(bytesRead / 1024), (unsigned)(len / 1024),
+                    (unsigned)((bytesRead * 100) / len));
+    }
+  }
+
+  return bytesRead;
+}
+
+/**
+ * Scarica tutto il body nel buffer immagine
+ * size < 0 (body compresso o senza Content-Length): il buffer cresce fino a MAX_IMAGE_SIZE
+ * Returns: true se il body è arrivato completo
+ */
+bool readBodyToImageBuffer(HttpBody& body, int size) {
+  if (size > 0) {
+    if (!allocImageBuffer(size)) return false;
+    imageBufferSize = readBodyBytes(body, imageBuffer, size);
+    return (imageBufferSize == (size_t)size);
+  }
+
+  size_t capacity = 65536;
+  if (!allocImageBuffer(capacity)) return false;
+
+  for (;;) {
+    if (imageBufferSize == capacity) {
+      if (capacity >= MAX_IMAGE_SIZE) {
+        Serial.println("Image larger than MAX_IMAGE_SIZE!");
+        return false;
+      }
+      capacity = min(capacity * 2, (size_t)MAX_IMAGE_SIZE);
+      uint8_t* grown = (uint8_t*)realloc(imageBuffer, capacity);
+      if (grown == nullptr) {
+        Serial.println("Failed to grow image buffer!");
+        return false;
+      }
+      imageBuffer = grown;
+    }
+
+    size_t chunk = httpBodyRead(body, imageBuffer + imageBufferSize, capacity - imageBufferSize);
+    if (chunk == 0) break;
+    imageBufferSize += chunk;
+  }
+
+  return !body.failed && imageBufferSize > 0;
+}
+
+/**
+ * Scarica il formato layered: header → anteprima (subito a schermo) → JPEG completo
+ * Con previewOnly si ferma dopo l'anteprima (il resto non viene scaricato)
+ * totalSize: Content-Length del file non compresso, -1 se non noto
+ * Returns: true se il JPEG completo è nel buffer
+ */
+bool downloadLayeredImage(HttpBody& body, int totalSize, bool previewOnly) {
+  uint8_t header[LAYERED_HEADER_SIZE];
+  if (readBodyBytes(body, header, sizeof(header)) != sizeof(header) ||
+      memcmp(header, LAYERED_IMAGE_MAGIC, 4) != 0) {
+    Serial.println("Invalid layered image header");
+    return false;
+  }
+
+  uint32_t previewSize = readLE32(header + 4);
+  uint32_t fullSize = readLE32(header + 8);
+  Serial.printf("Layered image: preview %u bytes, full %u bytes\n",
+                (unsigned)previewSize, (unsigned)fullSize);
+
+  // Content-Length (se presente) deve corrispondere all'header
+  if (previewSize == 0 || fullSize == 0 ||
+      (totalSize > 0 && (uint32_t)totalSize != LAYERED_HEADER_SIZE + previewSize + fullSize)) {
+    Serial.println("Layered image size mismatch");
+    return false;
+  }
+
+  // 1. Anteprima: a schermo appena arriva, con refresh veloce
+  uint8_t* preview = (uint8_t*)malloc(previewSize);
+  if (preview == nullptr) {
+    Serial.println("Failed to allocate preview buffer!");
+    return false;
+  }
+
+  bool previewOk = (readBodyBytes(body, preview, previewSize) == previewSize);
+  if (previewOk) {
+    displayImagePreview(preview, previewSize);
+  }
+  free(preview);
+
+  if (!previewOk) return false;
+  if (previewOnly) {
+    Serial.println("Low battery - stopping after preview layer");
+    return false;
+  }
+
+  // 2. JPEG completo (rifinisce l'anteprima)
+  return readBodyToImageBuffer(body, fullSize);
+}
+
+/**
+ * Scarica immagine da GitHub e la salva nel buffer
+ * IMAGE_LAYERED: scarica image/current.mmp mostrando prima l'anteprima
+ * IMAGE_TILED: scarica image/current.mmt intero (il delta è in downloadTiledImage)
+ * Returns: true se il contenuto completo è nel buffer, false se fallito
+ */
+bool downloadImage(ImageFormat format = IMAGE_JPEG, bool previewOnly = false) {
+  HTTPClient http;
+  const char* path = "current.jpg";
+  if (format == IMAGE_LAYERED) path = "current.mmp";
+  if (format == IMAGE_TILED) path = "current.mmt";
+  String url = imageURL(path);
+
+  Serial.printf("Downloading image: %s\n", url.c_str());
+  httpBegin(http, url);
+  int httpCode = http.GET();
+
+  if (httpCode != HTTP_CODE_OK) {
+    Serial.printf("Image download failed: %d\n", httpCode);
+    http.end();
+    return false;
+  }
+
+  HttpBody body;
+  if (!httpBodyBegin(body, http)) {
+    http.end();
+    return false;
+  }
+
+  // Con body compresso Content-Length è la dimensione compressa
+  int imageSize = (body.encoding == BODY_IDENTITY) ? http.getSize() : -1;
+  Serial.printf("Image size: %d bytes\n", http.getSize());
+
+  bool complete;
+  if (format == IMAGE_LAYERED) {
+    complete = downloadLayeredImage(body, imageSize, previewOnly);
+  } else {
+    complete = readBodyToImageBuffer(body, imageSize);
+  }
+
+  httpBodyEnd(body);
+  http.end();
+
+  Serial.printf("Image download complete: %u bytes\n", (unsigned)imageBufferSize);
+  return complete;
+}
+
+// ===== SD CONTENT STORE =====
+
+/**
+ * Calcola MD5 (hex) del buffer immagine corrente
+ */
+String imageBufferMD5() {
+  MD5Builder md5;
+  md5.begin();
+  md5.add(imageBuffer, imageBufferSize);
+  md5.calculate();
+  return md5.toString();
+}
+
+/**
+ * Aggiunge una riga all'indice (file + copia in RAM)
+ */
+void sdIndexAppend(const String& md5, size_t size, const String& fileName) {
+  String line = md5 + " " + String((unsigned long)size) + " " + fileName + "\n";
+
+  File index = SD.open(SD_INDEX_FILE, FILE_APPEND);
+  if (!index) {
+    Serial.println("SD: failed to open index for append");
+    return;
+  }
+  index.print(line);
+  index.close();
+
+  sdIndex += line;
+}
+
+/**
+ * Legge la riga n dell'indice
+ * Returns: true se la riga esiste ed è valida
+ */
+bool sdIndexEntryAt(int n, String& md5, String& fileName) {
+  int lineStart = 0;
+  for (int i = 0; i < n; i++) {
+    lineStart = sdIndex.indexOf('\n', lineStart);
+    if (lineStart < 0) return false;
+    lineStart++;
+  }
+
+  int lineEnd = sdIndex.indexOf('\n', lineStart);
+  if (lineEnd < 0) return false;
+
+  int sizeStart = sdIndex.indexOf(' ', lineStart);
+  int nameStart = sdIndex.indexOf(' ', sizeStart + 1);
+  if (sizeStart < 0 || nameStart < 0 || nameStart > lineEnd) return false;
+
+  md5 = sdIndex.substring(lineStart, sizeStart);
+  fileName = sdIndex.substring(nameStart + 1, lineEnd);
+  return true;
+}
+
+/**
+ * Numero di immagini nell'indice (= lunghezza playlist)
+ */
+int sdIndexCount() {
+  int count = 0;
+  for (int pos = sdIndex.indexOf('\n'); pos >= 0; pos = sdIndex.indexOf('\n', pos + 1)) {
+    count++;
+  }
+  return count;
+}
+
+/**
+ * Toglie dall'indice la riga di un file (file + copia in RAM)
+ */
+void sdIndexRemove(const String& fileName) {
+  int nameEnd = sdIndex.indexOf(" " + fileName + "\n");
+  if (nameEnd < 0) return;
+
+  int lineStart = sdIndex.lastIndexOf('\n', nameEnd) + 1;
+  int lineEnd = sdIndex.indexOf('\n', nameEnd + 1) + 1;
+  sdIndex = sdIndex.substring(0, lineStart) + sdIndex.substring(lineEnd);
+
+  File index = SD.open(SD_INDEX_FILE, FILE_WRITE);
+  if (!index) {
+    Serial.println("SD: failed to rewrite index");
+    return;
+  }
+  index.print(sdIndex);
+  index.close();
+}
+
+/**
+ * Cerca nell'indice il file con un dato MD5
+ * Una riga il cui file è stato cancellato dalla SD viene tolta dall'indice:
+ * il mirror successivo lo riscrive invece di considerarlo già presente
+ * Returns: nome file, o stringa vuota se non presente
+ */
+String sdIndexLookup(const String& md5) {
+  if (md5.length() == 0) return "";
+
+  int count = sdIndexCount();
+  String entryMD5, fileName;
+  for (int i = 0; i < count; i++) {
+    if (!sdIndexEntryAt(i, entryMD5, fileName) || entryMD5 != md5) continue;
+
+    if (SD.exists(String(SD_STORE_DIR) + "/" + fileName)) return fileName;
+
+    Serial.printf("SD: %s missing, dropped from index\n", fileName.c_str());
+    sdIndexRemove(fileName);
+    count--;
+    i--;
+  }
+  return "";
+}
+
+/**
+ * Indicizza i .jpg copiati a mano sulla SD (provisioning offline)
+ * Calcola l'MD5 solo per i file non ancora presenti nell'indice
+ */
+void sdIndexNewFiles() {
+  File dir = SD.open(SD_STORE_DIR);
+  if (!dir || !dir.isDirectory()) return;
+
+  uint8_t* chunk = (uint8_t*)heap_caps_malloc(SD_READ_CHUNK, MALLOC_CAP_DMA);
+  if (chunk == nullptr) {
+    dir.close();
+    return;
+  }
+
+  int added = 0;
+  for (File f = dir.openNextFile(); f; f = dir.openNextFile()) {
+    String fileName = f.name();
+    int slash = fileName.lastIndexOf('/');
+    if (slash >= 0) fileName = fileName.substring(slash + 1);
+
+    String lower = fileName;
+    lower.toLowerCase();
+    bool isJpeg = (lower.endsWith(".jpg") || lower.endsWith(".jpeg")) &&
+                  !lower.startsWith(".");  // Ignora file nascosti (._xxx.jpg di macOS)
+
+    if (f.isDirectory() || !isJpeg ||
+        sdIndex.indexOf(" " + fileName + "\n") >= 0) {
+      f.close();
+      continue;
+    }
+
+    // Nuovo file: calcola MD5 a chunk
+    MD5Builder md5;
+    md5.begin();
+    size_t n;
+    while ((n = f.read(chunk, SD_READ_CHUNK)) > 0) {
+      md5.add(chunk, n);
+    }
+    md5.calculate();
+
+    sdIndexAppend(md5.toString(), f.size(), fileName);
+    Serial.printf("SD: indexed %s\n", fileName.c_str());
+    added++;
+    f.close();
+  }
+
+  heap_caps_free(chunk);
+  dir.close();
+
+  if (added > 0) {
+    Serial.printf("SD: %d new file(s) added to index\n", added);
+  }
+}
+
+/**
+ * Monta la microSD e carica l'indice contenuti
+ * Returns: true se la SD è disponibile
+ */
+bool sdStoreBegin() {
+  if (!ENABLE_SD_STORE) return false;
+  if (sdMounted) return true;
+
+  SPI.begin(SD_PIN_SCK, SD_PIN_MISO, SD_PIN_MOSI, SD_PIN_CS);
+  if (!SD.begin(SD_PIN_CS, SPI, SD_SPI_FREQ)) {
+    Serial.println("SD: no card, content store disabled");
+    return false;
+  }
+
+  if (!SD.exists(SD_STORE_DIR) && !SD.mkdir(SD_STORE_DIR)) {
+    Serial.println("SD: failed to create content dir");
+    SD.end();
+    return false;
+  }
+
+  // Carica indice in RAM
+  sdIndex = "";
+  File index = SD.open(SD_INDEX_FILE, FILE_READ);
+  if (index) {
+    sdIndex = index.readString();
+    index.close();
+    if (sdIndex.length() > 0 && !sdIndex.endsWith("\n")) {
+      sdIndex += "\n";  // Riga finale troncata (es. file editato a mano)
+    }
+  }
+
+  sdMounted = true;
+  sdIndexNewFiles();
+
+  Serial.printf("SD: content store ready (%d images)\n", sdIndexCount());
+  return true;
+}
+
+/**
+ * Legge un file dalla SD nel buffer immagine
+ * Lettura a chunk in un buffer DMA interno, poi copia nel buffer (PSRAM)
+ * Returns: true se il file è stato letto completamente
+ */
+bool sdReadImage(const String& fileName) {
+  String path = String(SD_STORE_DIR) + "/" + fileName;
+  File f = SD.open(path, FILE_READ);
+  if (!f) {
+    Serial.printf("SD: missing file %s\n", path.c_str());
+    return false;
+  }
+
+  size_t size = f.size();
+  uint8_t* chunk = (uint8_t*)heap_caps_malloc(SD_READ_CHUNK, MALLOC_CAP_DMA);
+  if (size == 0 || chunk == nullptr || !allocImageBuffer(size)) {
+    if (chunk != nullptr) heap_caps_free(chunk);
+    f.close();
+    return false;
+  }
+
+  size_t bytesRead = 0;
+  while (bytesRead < size) {
+    size_t n = f.read(chunk, min((size_t)SD_READ_CHUNK, size - bytesRead));
+    if (n == 0) break;
+    memcpy(imageBuffer + bytesRead, chunk, n);
+    bytesRead += n;
+  }
+
+  heap_caps_free(chunk);
+  f.close();
+
+  if (bytesRead != size) {
+    Serial.printf("SD: short read on %s (%u/%u bytes)\n",
+                  path.c_str(), (unsigned)bytesRead, (unsigned)size);
+    free(imageBuffer);
+    imageBuffer = nullptr;
+    return false;
+  }
+
+  imageBufferSize = bytesRead;
+  Serial.printf("SD: loaded %s (%u bytes)\n", path.c_str(), (unsigned)bytesRead);
+  return true;
+}
+
+/**
+ * Salva sulla SD l'immagine nel buffer (se non già presente)
+ */
+void sdMirrorImage(const String& md5) {
+  if (!sdStoreBegin() || imageBuffer == nullptr || imageBufferSize == 0) return;
+
+  if (sdIndexLookup(md5).length() > 0) {
+    Serial.println("SD: image already mirrored");
+    return;
+  }
+
+  String fileName = md5 + (tiledImageCount(imageBuffer, imageBufferSize) > 0 ? ".mmt" : ".jpg");
+  String path = String(SD_STORE_DIR) + "/" + fileName;
+  File f = SD.open(path, FILE_WRITE);
+  if (!f) {
+    Serial.printf("SD: failed to create %s\n", path.c_str());
+    return;
+  }
+
+  size_t written = f.write(imageBuffer, imageBufferSize);
+  f.close();
+
+  if (written != imageBufferSize) {
+    Serial.println("SD: mirror write failed (card full?)");
+    SD.remove(path);
+    return;
+  }
+
+  sdIndexAppend(md5, imageBufferSize, fileName);
+  Serial.printf("SD: mirrored image as %s\n", fileName.c_str());
+}
+
+/**
+ * Carica dalla SD l'immagine con un dato MD5 (zero rete)
+ */
+bool sdLoadImageByMD5(const String& md5) {
+  if (!sdStoreBegin()) return false;
+
+  String fileName = sdIndexLookup(md5);
+  if (fileName.length() == 0) return false;
+
+  return sdReadImage(fileName);
+}
+
+/**
+ * Carica la prossima immagine della playlist SD (ordine indice)
+ * La posizione viene salvata in NVS e avanza a ogni chiamata
+ */
+bool sdLoadNextPlaylistImage() {
+  if (!sdStoreBegin()) return false;
+
+  int count = sdIndexCount();
+  if (count == 0) {
+    Serial.println("SD: playlist empty");
+    return false;
+  }
+
+  prefs.begin("mmconfig", false);
+  int pos = prefs.getInt("sdPlaylistPos", 0);
+
+  // Salta eventuali file mancanti (max un giro completo)
+  bool loaded = false;
+  for (int tries = 0; tries < count && !loaded; tries++) {
+    String md5, fileName;
+    int entry = pos % count;
+    pos = entry + 1;
+    if (sdIndexEntryAt(entry, md5, fileName)) {
+      Serial.printf("SD: playlist %d/%d\n", entry + 1, count);
+      loaded = sdReadImage(fileName);
+    }
+  }
+
+  prefs.putInt("sdPlaylistPos", pos % count);
+  prefs.end();
+
+  return loaded;
+}
+
+/**
+ * Smonta la SD (prima del deep sleep)
+ */
+void sdStoreEnd() {
+  if (!sdMounted) return;
+  SD.end();
+  sdMounted = false;
+}
+
+// ===== IMAGE SLOTS (FLASH A/B) =====
+
+/**
+ * Calcola CRC32 dell'header (escluso il campo crc)
+ */
+uint32_t imageSlotCRC(const ImageSlotHeader& hdr) {
+  return esp_rom_crc32_le(0, (const uint8_t*)&hdr, offsetof(ImageSlotHeader, crc));
+}
+
+/**
+ * Offset dello slot nella partizione
+ */
+uint32_t imageSlotOffset(int slot) {
+  return slot * imageSlotSize;
+}
+
+/**
+ * Legge e valida l'header di uno slot
+ * Returns: true se magic e CRC sono corretti
+ */
+bool imageSlotReadHeader(int slot, ImageSlotHeader& hdr) {
+  if (esp_partition_read(imageSlotPartition, imageSlotOffset(slot), &hdr, sizeof(hdr)) != ESP_OK) {
+    return false;
+  }
+  return hdr.magic == IMAGE_SLOT_MAGIC &&
+         hdr.crc == imageSlotCRC(hdr) &&
+         hdr.size > 0 && hdr.size <= imageSlotSize - IMAGE_SLOT_HEADER_SIZE;
+}
+
+/**
+ * Trova la partizione e lo slot attivo (una volta per wake)
+ * Returns: true se gli slot sono utilizzabili
+ */
+bool imageSlotsBegin() {
+  if (!ENABLE_IMAGE_SLOTS) return false;
+  if (imageSlotPartition != nullptr) return true;
+
+  const esp_partition_t* part = esp_partition_find_first(
+      ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)IMAGE_SLOT_PARTITION_SUBTYPE,
+      IMAGE_SLOT_PARTITION);
+  if (part == nullptr) {
+    Serial.println("Image slots: partition not found, slots disabled");
+    return false;
+  }
+
+  imageSlotPartition = part;
+  imageSlotSize = (part->size / 2) & ~(SPI_FLASH_SEC_SIZE - 1);  // Allineato al settore
+
+  ImageSlotHeader hdr[2];
+  bool valid[2] = { imageSlotReadHeader(0, hdr[0]), imageSlotReadHeader(1, hdr[1]) };
+
+  activeImageSlot = -1;
+  for (int i = 0; i < 2; i++) {
+    if (valid[i] && (activeImageSlot < 0 || hdr[i].seq > activeSlotHeader.seq)) {
+      activeImageSlot = i;
+      activeSlotHeader = hdr[i];
+    }
+  }
+
+  if (activeImageSlot >= 0) {
+    Serial.printf("Image slots: active %c (seq %u, %u bytes, %s)\n",
+                  'A' + activeImageSlot, (unsigned)activeSlotHeader.seq,
+                  (unsigned)activeSlotHeader.size, activeSlotHeader.md5);
+  } else {
+    Serial.println("Image slots: empty");
+  }
+  return true;
+}
+
+/**
+ * Calcola MD5 (hex) di un'area dello slot leggendo la flash
+ * Lettura a chunk in un buffer interno (niente copia completa in RAM)
+ */
+String imageSlotMD5(int slot, uint32_t size) {
+  uint8_t* chunk = (uint8_t*)heap_caps_malloc(SPI_FLASH_SEC_SIZE, MALLOC_CAP_INTERNAL);
+  if (chunk == nullptr) return "";
+
+  MD5Builder md5;
+  md5.begin();
+  uint32_t base = imageSlotOffset(slot) + IMAGE_SLOT_HEADER_SIZE;
+  for (uint32_t pos = 0; pos < size; pos += SPI_FLASH_SEC_SIZE) {
+    uint32_t n = min((uint32_t)SPI_FLASH_SEC_SIZE, size - pos);
+    if (esp_partition_read(imageSlotPartition, base + pos, chunk, n) != ESP_OK) {
+      heap_caps_free(chunk);
+      return "";
+    }
+    md5.add(chunk, n);
+  }
+  heap_caps_free(chunk);
+
+  md5.calculate();
+  return md5.toString();
+}
+
+/**
+ * Scrive il buffer immagine nello slot inattivo e lo riverifica
+ * Lo slot attivo non viene toccato: finché non c'è il commit resta valido
+ * Returns: slot scritto, o -1 se errore
+ */
+int imageSlotStage(const String& md5) {
+  if (!imageSlotsBegin() || imageBuffer == nullptr || imageBufferSize == 0) return -1;
+
+  if (imageBufferSize > imageSlotSize - IMAGE_SLOT_HEADER_SIZE) {
+    Serial.printf("Image slots: image too large (%u bytes)\n", (unsigned)imageBufferSize);
+    return -1;
+  }
+
+  int slot = (activeImageSlot == 0) ? 1 : 0;
+  uint32_t offset = imageSlotOffset(slot);
+
+  // Cancella header + dati: lo slot torna invalido finché non c'è il commit
+  uint32_t eraseSize = (IMAGE_SLOT_HEADER_SIZE + imageBufferSize + SPI_FLASH_SEC_SIZE - 1) &
+                       ~(SPI_FLASH_SEC_SIZE - 1);
+  if (esp_partition_erase_range(imageSlotPartition, offset, eraseSize) != ESP_OK ||
+      esp_partition_write(imageSlotPartition, offset + IMAGE_SLOT_HEADER_SIZE,
+                          imageBuffer, imageBufferSize) != ESP_OK) {
+    Serial.printf("Image slots: write to slot %c failed\n", 'A' + slot);
+    return -1;
+  }
+
+  // Rilettura: quello che è in flash deve avere lo stesso MD5
+  String flashMD5 = imageSlotMD5(slot, imageBufferSize);
+  if (flashMD5 != md5) {
+    Serial.printf("Image slots: verify failed on slot %c (%s)\n", 'A' + slot, flashMD5.c_str());
+    return -1;
+  }
+
+  Serial.printf("Image slots: staged in slot %c\n", 'A' + slot);
+  return slot;
+}
+
+/**
+ * Attiva lo slot scritto da imageSlotStage() (scrittura header)
+ */
+bool imageSlotCommit(int slot, const String& md5) {
+  ImageSlotHeader hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.magic = IMAGE_SLOT_MAGIC;
+  hdr.seq = (activeImageSlot >= 0) ? activeSlotHeader.seq + 1 : 1;
+  hdr.size = imageBufferSize;
+  strlcpy(hdr.md5, md5.c_str(), sizeof(hdr.md5));
+  hdr.crc = imageSlotCRC(hdr);
+
+  if (esp_partition_write(imageSlotPartition, imageSlotOffset(slot), &hdr, sizeof(hdr)) != ESP_OK) {
+    Serial.println("Image slots: commit failed");
+    return false;
+  }
+
+  activeImageSlot = slot;
+  activeSlotHeader = hdr;
+  Serial.printf("Image slots: slot %c active (seq %u)\n", 'A' + slot, (unsigned)hdr.seq);
+  return true;
+}
+
+/**
+ * Carica nel buffer l'immagine dello slot attivo (zero rete)
+ * Returns: true se caricata e con MD5 corretto
+ */
+bool imageSlotLoadActive() {
+  if (!imageSlotsBegin() || activeImageSlot < 0) return false;
+
+  if (!allocImageBuffer(activeSlotHeader.size)) return false;
+
+  uint32_t offset = imageSlotOffset(activeImageSlot) + IMAGE_SLOT_HEADER_SIZE;
+  if (esp_partition_read(imageSlotPartition, offset, imageBuffer, activeSlotHeader.size) != ESP_OK) {
+    Serial.println("Image slots: read failed");
+    free(imageBuffer);
+    imageBuffer = nullptr;
+    return false;
+  }
+  imageBufferSize = activeSlotHeader.size;
+
+  if (imageBufferMD5() != activeSlotHeader.md5) {
+    Serial.printf("Image slots: slot %c corrupted\n", 'A' + activeImageSlot);
+    free(imageBuffer);
+    imageBuffer = nullptr;
+    imageBufferSize = 0;
+    return false;
   }
 
-  return false;
+  Serial.printf("Image slots: loaded slot %c (%u bytes)\n",
+                'A' + activeImageSlot, (unsigned)imageBufferSize);
+  return true;
 }
 
 /**
- * Verifica batteria sufficiente per update
+ * Installa l'immagine appena scaricata nel buffer
+ * 1. MD5 diverso da quello atteso → scartata (schermo invariato)
+ * 2. Staging nello slot inattivo + rilettura
+ * 3. Decode/display: se fallisce rollback allo slot attivo, altrimenti commit
+ * expectedMD5 vuoto = nessun MD5 di riferimento (solo staging)
+ * Returns: true se la nuova immagine è a schermo
  */
-bool isBatteryOkForUpdate() {
-  int batteryLevel = M5.Power.getBatteryLevel();
-  return (batteryLevel >= MIN_BATTERY_PERCENT);
-}
+bool installImage(const String& expectedMD5) {
+  String md5 = imageBufferMD5();
 
-/**
- * Sincronizza ora via NTP (richiede WiFi connesso)
- */
-void syncTimeFromNTP() {
-  Serial.println("Syncing time from NTP...");
-  configTime(GMT_OFFSET_SEC, DAYLIGHT_OFFSET_SEC, NTP_SERVER);
+  if (expectedMD5.length() > 0 && md5 != expectedMD5) {
+    Serial.printf("Image MD5 mismatch (got %s), discarding download\n", md5.c_str());
+    free(imageBuffer);
+    imageBuffer = nullptr;
+    imageBufferSize = 0;
+    return false;
+  }
 
-  // Aspetta max 10s per sync
-  int timeout = 10;
-  while (timeout > 0) {
-    struct tm timeinfo;
-    if (getLocalTime(&timeinfo)) {
-      Serial.printf("Time synced: %04d-%02d-%02d %02d:%02d:%02d\n",
-                    timeinfo.tm_year + 1900, timeinfo.tm_mon + 1, timeinfo.tm_mday,
-                    timeinfo.tm_hour, timeinfo.tm_min, timeinfo.tm_sec);
-      return;
+  int slot = imageSlotStage(md5);  // -1: slot non disponibili, si mostra comunque
+
+  if (!displayImageFullscreen()) {
+    Serial.println("Decode failed - rolling back to last good image");
+    if (expectedMD5.length() > 0) {
+      // Contenuto integro ma non decodificabile: inutile riscaricarlo
+      prefs.begin("mmconfig", false);
+      prefs.putString("rejectedMD5", md5);
+      prefs.end();
+    }
+    if (imageSlotLoadActive()) {
+      displayImageFullscreen();
     }
-    delay(1000);
-    timeout--;
+    return false;
   }
-  Serial.println("NTP sync timeout");
-}
 
-/**
- * Mostra messaggio su display e-ink
- */
-void displayMessage(const char* message, int y = 270) {
-  M5.Display.setFont(&fonts::FreeSans18pt7b);
-  M5.Display.setTextDatum(middle_center);
-  M5.Display.setTextColor(TFT_BLACK, TFT_WHITE);
-  M5.Display.fillScreen(TFT_WHITE);
-  M5.Display.drawString(message, 480, y);
-  M5.Display.display();  // Full refresh
-  // Non spegniamo display qui perché potrebbero esserci più messaggi in sequenza
+  if (slot >= 0) {
+    imageSlotCommit(slot, md5);
+  }
+  return true;
 }
 
-// ===== IMAGE FUNCTIONS =====
+// ===== TILED IMAGE UPDATE (HTTP RANGE) =====
 
 /**
- * Scarica metadata immagine da GitHub
- * Returns: MD5 hash dell'immagine remota, o stringa vuota se errore
+ * Scarica un intervallo di byte (HTTP Range) direttamente in dest
+ * Senza compressione: gli offset del Range sono sui byte del file
+ * Returns: byte ricevuti (al massimo len), 0 se errore o Range non supportato
  */
-String downloadImageMetadata() {
+size_t httpGetRange(const String& url, uint32_t start, uint32_t len, uint8_t* dest) {
   HTTPClient http;
-  String metadataURL = "https://raw.githubusercontent.com/" + String(GITHUB_USER) +
-                       "/" + String(GITHUB_REPO) + "/main/image/image_meta.json";
-
-  Serial.printf("Downloading metadata: %s\n", metadataURL.c_str());
-  http.begin(metadataURL);
+  httpBegin(http, url, false);
+  http.addHeader("Range", "bytes=" + String(start) + "-" + String(start + len - 1));
   int httpCode = http.GET();
 
-  if (httpCode != HTTP_CODE_OK) {
-    Serial.printf("Metadata download failed: %d\n", httpCode);
+  // 200 = il server ignora Range: meglio un download completo che leggere tutto qui
+  if (httpCode != HTTP_CODE_PARTIAL_CONTENT ||
+      !http.header("Content-Range").startsWith("bytes " + String(start) + "-")) {
+    Serial.printf("Range request failed: %d\n", httpCode);
     http.end();
-    return "";
+    return 0;
   }
 
-  String payload = http.getString();
+  HttpBody body;
+  size_t received = 0;
+  if (httpBodyBegin(body, http)) {
+    int size = http.getSize();
+    received = readBodyBytes(body, dest, (size > 0 && (uint32_t)size < len) ? size : len);
+    httpBodyEnd(body);
+  }
   http.end();
-
-  // Parse JSON per ottenere MD5
-  int md5Start = payload.indexOf("\"md5\":") + 7;
-  int md5End = payload.indexOf("\"", md5Start);
-  String md5 = payload.substring(md5Start, md5End);
-
-  Serial.printf("Remote image MD5: %s\n", md5.c_str());
-  return md5;
+  return received;
 }
 
 /**
- * Scarica immagine da GitHub e la salva nel buffer
- * Returns: true se successo, false se fallito
+ * Costruisce il nuovo contenitore a tile partendo da quello attuale (oldData)
+ * 1. Indice nuovo con una richiesta Range (header + tabella tile)
+ * 2. Tile con MD5 già presente: copiate dal contenitore attuale
+ * 3. Tile nuove: richieste Range (tile contigue unite, max TILED_MAX_RANGES)
+ * 4. Verifica MD5 del contenitore ricostruito
+ * Imposta tileRefreshMask con le tile cambiate rispetto alla stessa posizione
+ * Returns: true se il nuovo contenitore è nel buffer immagine
  */
-bool downloadImage() {
-  HTTPClient http;
-  String imageURL = "https://raw.githubusercontent.com/" + String(GITHUB_USER) +
-                    "/" + String(GITHUB_REPO) + "/main/image/current.jpg";
-
-  Serial.printf("Downloading image: %s\n", imageURL.c_str());
-  http.begin(imageURL);
-  int httpCode = http.GET();
-
-  if (httpCode != HTTP_CODE_OK) {
-    Serial.printf("Image download failed: %d\n", httpCode);
-    http.end();
+bool downloadTiledDelta(const String& url, const uint8_t* oldData, size_t oldSize,
+                        const String& expectedMD5) {
+  const size_t indexMax = TILED_HEADER_SIZE + TILED_MAX_TILES * TILED_ENTRY_SIZE;
+  uint8_t* index = (uint8_t*)malloc(indexMax);
+  if (index == nullptr) {
+    Serial.println("Failed to allocate tile index!");
     return false;
   }
 
-  int imageSize = http.getSize();
-  Serial.printf("Image size: %d bytes\n", imageSize);
-
-  // Alloca buffer per immagine
-  if (imageBuffer != nullptr) {
-    free(imageBuffer);
-  }
-  imageBuffer = (uint8_t*)malloc(imageSize);
-
-  if (imageBuffer == nullptr) {
-    Serial.println("Failed to allocate image buffer!");
-    http.end();
+  // 1. Indice nuovo (il file può essere più corto di indexMax: il server taglia)
+  int count = tiledImageCount(index, httpGetRange(url, 0, indexMax, index));
+  if (count == 0) {
+    Serial.println("Tiles: invalid remote index");
+    free(index);
     return false;
   }
-
-  // Scarica immagine
-  WiFiClient* stream = http.getStreamPtr();
-  int bytesRead = 0;
-
-  while (http.connected() && bytesRead < imageSize) {
-    size_t available = stream->available();
-    if (available) {
-      int chunk = stream->readBytes(imageBuffer + bytesRead, min(available, (size_t)(imageSize - bytesRead)));
-      bytesRead += chunk;
-
-      if (bytesRead % 51200 == 0) {  // Progress ogni 50KB
-        Serial.printf("Downloaded: %d / %d KB (%d%%)\n",
-                      bytesRead / 1024, imageSize / 1024,
-                      (bytesRead * 100) / imageSize);
+  size_t indexSize = TILED_HEADER_SIZE + count * TILED_ENTRY_SIZE;
+
+  // 2. Confronto con l'indice attuale
+  int oldCount = tiledImageCount(oldData, oldSize);
+  int reuse[TILED_MAX_TILES];       // Tile attuale con lo stesso MD5 (-1 = da scaricare)
+  size_t newSize = indexSize;
+  size_t fetchBytes = 0;
+  int fetchCount = 0;
+  tileRefreshMask = 0;
+
+  for (int i = 0; i < count; i++) {
+    TileEntry tile = tileEntryAt(index, i);
+    newSize = max(newSize, (size_t)tile.offset + tile.size);
+    reuse[i] = -1;
+    bool samePosition = false;
+
+    for (int j = 0; j < oldCount; j++) {
+      TileEntry old = tileEntryAt(oldData, j);
+      if (memcmp(old.md5, tile.md5, 16) != 0 || old.size != tile.size ||
+          (uint64_t)old.offset + old.size > oldSize) {
+        continue;
+      }
+      if (reuse[i] < 0) reuse[i] = j;
+      if (old.x == tile.x && old.y == tile.y && old.w == tile.w && old.h == tile.h) {
+        samePosition = true;
       }
     }
-    delay(1);
-  }
-
-  http.end();
-  imageBufferSize = bytesRead;
 
-  Serial.printf("Image download complete: %d bytes\n", bytesRead);
-  return (bytesRead == imageSize);
-}
-
-/**
- * Mostra immagine JPEG a schermo intero
- * Smart crop: mantiene aspect ratio, riempie schermo, croppa dal centro
- */
-void displayImageFullscreen() {
-  if (imageBuffer == nullptr || imageBufferSize == 0) {
-    Serial.println("No image to display!");
-    return;
+    if (reuse[i] < 0) {
+      fetchBytes += tile.size;
+      fetchCount++;
+    }
+    if (!samePosition) {
+      tileRefreshMask |= (1ULL << i);
+    }
   }
 
-  Serial.println("Displaying image fullscreen...");
+  if (newSize > MAX_IMAGE_SIZE) {
+    Serial.println("Tiles: image larger than MAX_IMAGE_SIZE");
+    free(index);
+    return false;
+  }
 
-  M5.Display.wakeup();  // Sveglia display se in sleep
-  M5.Display.setColorDepth(8);  // 8-bit grayscale
-  M5.Display.fillScreen(TFT_BLACK);
+  Serial.printf("Tiles: %d of %d to fetch (%u of %u bytes)\n", fetchCount, count,
+                (unsigned)fetchBytes, (unsigned)newSize);
 
-  // Get JPEG dimensions using TJpgDec parser
-  lgfxJdec jdec;
-  uint8_t workbuf[3100];  // Working buffer for TJpgDec
+  if (fetchBytes * 100 > newSize * TILED_FULL_FETCH_PERCENT) {
+    Serial.println("Tiles: most of the image changed");
+    free(index);
+    return false;
+  }
 
-  // JPEG data source for parser
-  struct JpgDataSource {
-    const uint8_t* buffer;
-    size_t size;
-    size_t pos;
-  };
+  // 3. Nuovo contenitore: indice + tile riusate
+  uint8_t* data = (uint8_t*)malloc(newSize);
+  if (data == nullptr) {
+    Serial.println("Failed to allocate image buffer!");
+    free(index);
+    return false;
+  }
+  memcpy(data, index, indexSize);
 
-  // Data read callback
-  auto jpgRead = [](void* data, uint8_t* buf, uint32_t len) -> uint32_t {
-    JpgDataSource* src = (JpgDataSource*)data;
-    if (src->pos >= src->size) return 0;
-    uint32_t remain = src->size - src->pos;
-    if (len > remain) len = remain;
-    memcpy(buf, src->buffer + src->pos, len);
-    src->pos += len;
-    return len;
+  struct ByteRange {
+    uint32_t start, end;  // [start, end)
   };
+  ByteRange ranges[TILED_MAX_TILES];
+  int rangeCount = 0;
+
+  for (int i = 0; i < count; i++) {
+    TileEntry tile = tileEntryAt(index, i);
+    if (reuse[i] >= 0) {
+      TileEntry old = tileEntryAt(oldData, reuse[i]);
+      memcpy(data + tile.offset, oldData + old.offset, tile.size);
+      continue;
+    }
 
-  JpgDataSource jpgData = { imageBuffer, imageBufferSize, 0 };
-
-  // Parse JPEG header to get dimensions
-  JRESULT res = lgfx_jd_prepare(&jdec, jpgRead, &jpgData, 3100, workbuf);
+    // Inserimento ordinato per offset
+    int pos = rangeCount++;
+    while (pos > 0 && ranges[pos - 1].start > tile.offset) {
+      ranges[pos] = ranges[pos - 1];
+      pos--;
+    }
+    ranges[pos] = { tile.offset, tile.offset + tile.size };
+  }
+  free(index);
+
+  // 4. Unisce intervalli contigui, poi quelli più vicini finché bastano TILED_MAX_RANGES
+  //    (ogni Range è una connessione: pochi byte in più costano meno di un handshake)
+  while (rangeCount > 1) {
+    int best = 0;
+    for (int i = 1; i < rangeCount - 1; i++) {
+      if (ranges[i + 1].start - ranges[i].end < ranges[best + 1].start - ranges[best].end) {
+        best = i;
+      }
+    }
+    bool adjacent = ranges[best + 1].start <= ranges[best].end;
+    if (!adjacent && rangeCount <= TILED_MAX_RANGES) break;
 
-  if (res != JDR_OK) {
-    Serial.printf("Failed to parse JPEG: %d\n", res);
-    M5.Display.drawString("Invalid JPEG", 480, 270);
-    M5.Display.display();
-    M5.Display.sleep();
-    return;
+    ranges[best].end = max(ranges[best].end, ranges[best + 1].end);
+    for (int i = best + 1; i < rangeCount - 1; i++) {
+      ranges[i] = ranges[i + 1];
+    }
+    rangeCount--;
   }
 
-  int jpgWidth = jdec.width;
-  int jpgHeight = jdec.height;
+  bool complete = true;
+  for (int i = 0; i < rangeCount && complete; i++) {
+    uint32_t len = ranges[i].end - ranges[i].start;
+    Serial.printf("Tiles: fetching bytes %u-%u\n", (unsigned)ranges[i].start,
+                  (unsigned)(ranges[i].end - 1));
+    complete = (httpGetRange(url, ranges[i].start, len, data + ranges[i].start) == len);
+  }
 
-  Serial.printf("Image dimensions: %dx%d\n", jpgWidth, jpgHeight);
+  if (imageBuffer != nullptr) {
+    free(imageBuffer);
+  }
+  imageBuffer = data;
+  imageBufferSize = newSize;
 
-  // PORTRAIT MODE: 540×960 (9:16 aspect ratio)
-  const int SCREEN_WIDTH = 540;
-  const int SCREEN_HEIGHT = 960;
+  // 5. Il contenitore ricostruito deve essere identico a quello pubblicato
+  if (!complete || imageBufferMD5() != expectedMD5) {
+    Serial.println("Tiles: rebuilt image does not match remote MD5");
+    return false;
+  }
 
-  // Calcola aspect ratio
-  float imgRatio = (float)jpgWidth / (float)jpgHeight;
-  float screenRatio = (float)SCREEN_WIDTH / (float)SCREEN_HEIGHT;  // 9:16 = 0.5625
+  Serial.printf("Tiles: image rebuilt, %d tiles changed on screen\n",
+                __builtin_popcountll(tileRefreshMask));
+  return true;
+}
 
-  int drawX = 0, drawY = 0;
-  int drawWidth = SCREEN_WIDTH, drawHeight = SCREEN_HEIGHT;
+/**
+ * Scarica un'immagine a tile: delta via Range se nello slot attivo c'è
+ * già un contenitore a tile, altrimenti (o se il delta fallisce) file intero
+ * Returns: true se il nuovo contenitore è nel buffer immagine
+ */
+bool downloadTiledImage(const String& expectedMD5) {
+  String url = imageURL("current.mmt");
+  tileRefreshMask = 0;
 
-  // Smart crop: scala per riempire, poi offset per centrare
-  if (imgRatio > screenRatio) {
-    // Immagine più larga: scala in base all'altezza, croppa i lati
-    drawHeight = SCREEN_HEIGHT;
-    drawWidth = (int)((float)jpgWidth * (float)SCREEN_HEIGHT / (float)jpgHeight);
-    drawX = -(drawWidth - SCREEN_WIDTH) / 2;  // Centra orizzontalmente
-    Serial.printf("Wide image: crop sides (draw at x=%d, width=%d)\n", drawX, drawWidth);
-  } else {
-    // Immagine più alta: scala in base alla larghezza, croppa top/bottom
-    drawWidth = SCREEN_WIDTH;
-    drawHeight = (int)((float)jpgHeight * (float)SCREEN_WIDTH / (float)jpgWidth);
-    drawY = -(drawHeight - SCREEN_HEIGHT) / 2;  // Centra verticalmente
-    Serial.printf("Tall image: crop top/bottom (draw at y=%d, height=%d)\n", drawY, drawHeight);
+  if (!imageSlotLoadActive() || tiledImageCount(imageBuffer, imageBufferSize) == 0) {
+    Serial.println("Tiles: no tiled image on flash, full download");
+    return downloadImage(IMAGE_TILED);
   }
 
-  // Disegna con dimensioni calcolate (overflow viene clippato automaticamente)
-  M5.Display.drawJpg(imageBuffer, imageBufferSize, drawX, drawY, drawWidth, drawHeight);
+  // Il contenitore attuale resta come base, il nuovo va in un buffer a parte
+  uint8_t* oldData = imageBuffer;
+  size_t oldSize = imageBufferSize;
+  imageBuffer = nullptr;
+  imageBufferSize = 0;
 
-  M5.Display.display();  // Full refresh
-  M5.Display.sleep();    // Spegni display
+  bool rebuilt = downloadTiledDelta(url, oldData, oldSize, expectedMD5);
+  free(oldData);
 
-  Serial.println("Image displayed with smart crop!");
+  if (!rebuilt) {
+    Serial.println("Tiles: falling back to full download");
+    tileRefreshMask = 0;
+    return downloadImage(IMAGE_TILED);
+  }
+  return true;
 }
 
 /**
@@ -395,11 +2394,13 @@ void checkAndUpdateImage() {
   // 2. Connetti WiFi (prova tutte le reti disponibili)
   if (!connectToWiFi()) {
     Serial.println("Failed to connect to WiFi, skipping image check");
+    networkUnavailable = true;
     return;
   }
 
   // 3. Scarica metadata
-  String remoteMD5 = downloadImageMetadata();
+  ImageMeta meta = downloadImageMetadata();
+  String remoteMD5 = meta.md5;
 
   if (remoteMD5.length() == 0) {
     Serial.println("Failed to get image metadata");
@@ -413,40 +2414,94 @@ void checkAndUpdateImage() {
   String localMD5 = prefs.getString("imageMD5", "");
   prefs.end();
 
+  // Conta anche lo slot attivo: può avere l'immagine giusta anche se imageMD5 non c'è
+  String activeMD5 = (imageSlotsBegin() && activeImageSlot >= 0) ? String(activeSlotHeader.md5) : "";
+
   Serial.printf("Local MD5: %s\n", localMD5.c_str());
   Serial.printf("Remote MD5: %s\n", remoteMD5.c_str());
 
-  if (remoteMD5 == localMD5 && localMD5.length() > 0) {
+  if ((remoteMD5 == localMD5 && localMD5.length() > 0) || remoteMD5 == activeMD5) {
+    if (remoteMD5 != localMD5) {
+      prefs.begin("mmconfig", false);
+      prefs.putString("imageMD5", remoteMD5);
+      prefs.end();
+    }
     Serial.println("Image already up to date!");
     WiFi.disconnect(true);
     WiFi.mode(WIFI_OFF);
     return;
   }
 
-  // 5. Nuova immagine! Scarica
+  // Immagine remota già scaricata integra ma non decodificabile: non riprovare
+  prefs.begin("mmconfig", true);
+  String rejectedMD5 = prefs.getString("rejectedMD5", "");
+  prefs.end();
+
+  if (remoteMD5 == rejectedMD5) {
+    Serial.println("Remote image failed to decode before, skipping");
+    WiFi.disconnect(true);
+    WiFi.mode(WIFI_OFF);
+    return;
+  }
+
+  // 5. Batteria bassa + formato layered: basta l'anteprima (una volta sola)
+  bool previewOnly = (meta.format == IMAGE_LAYERED) && M5.Power.getBatteryLevel() < runtimeConfig.previewOnlyBatteryPercent;
+  if (previewOnly) {
+    prefs.begin("mmconfig", true);
+    String previewMD5 = prefs.getString("previewMD5", "");
+    prefs.end();
+
+    if (previewMD5 == remoteMD5) {
+      Serial.println("Preview already shown, full image deferred (low battery)");
+      WiFi.disconnect(true);
+      WiFi.mode(WIFI_OFF);
+      return;
+    }
+  }
+
+  // 6. Nuova immagine! Scarica (formato tile: solo le tile cambiate)
   Serial.println("New image found! Downloading...");
 
-  bool success = downloadImage();
+  bool success = (meta.format == IMAGE_TILED) ? downloadTiledImage(remoteMD5)
+                                              : downloadImage(meta.format, previewOnly);
 
   if (!success) {
-    Serial.println("Image download failed!");
     WiFi.disconnect(true);
     WiFi.mode(WIFI_OFF);
+
+    if (previewOnly && previewDisplayed) {
+      // Il JPEG completo arriverà a un check con più batteria
+      prefs.begin("mmconfig", false);
+      prefs.putString("previewMD5", remoteMD5);
+      prefs.end();
+      Serial.println("Preview displayed, full image deferred (low battery)");
+      return;
+    }
+
+    Serial.println("Image download failed!");
     return;
   }
 
-  // 6. Spegni WiFi
+  // 7. Spegni WiFi
   WiFi.disconnect(true);
   WiFi.mode(WIFI_OFF);
 
-  // 7. Mostra nuova immagine
-  displayImageFullscreen();
+  // 8. Verifica MD5, staging nello slot inattivo, display (rifinisce l'eventuale
+  //    anteprima) e commit; se il decode fallisce torna all'immagine precedente
+  if (!installImage(remoteMD5)) {
+    Serial.println("New image rejected, keeping last good image");
+    return;
+  }
 
-  // 8. Salva MD5
+  // 9. Salva MD5
   prefs.begin("mmconfig", false);
   prefs.putString("imageMD5", remoteMD5);
+  prefs.remove("previewMD5");
   prefs.end();
 
+  // 10. Mirror su SD (per fallback offline)
+  sdMirrorImage(remoteMD5);
+
   Serial.println("Image updated successfully!");
 }
 
@@ -458,7 +2513,7 @@ void checkAndUpdateImage() {
  */
 bool downloadAndUpdateOTA(const char* url) {
   HTTPClient http;
-  http.begin(url);
+  httpBegin(http, String(url), false);  // Update vuole il .bin così com'è
 
   Serial.printf("Downloading firmware: %s\n", url);
   int httpCode = http.GET();
@@ -487,31 +2542,30 @@ bool downloadAndUpdateOTA(const char* url) {
   WiFiClient* stream = http.getStreamPtr();
 
   // Download e scrittura diretta su flash OTA partition
-  while (http.connected() && (currentLength < totalLength || totalLength == -1)) {
-    size_t availableSize = stream->available();
-
-    if (availableSize) {
-      int bytesRead = stream->readBytes(buff, min(availableSize, sizeof(buff)));
-
-      // Scrivi su OTA partition
-      if (Update.write(buff, bytesRead) != bytesRead) {
-        Serial.println("OTA write failed!");
-        Update.abort();
-        http.end();
-        return false;
-      }
+  while (currentLength < totalLength || totalLength == -1) {
+    size_t availableSize = waitForStreamData(stream, NET_READ_TIMEOUT);
+    if (availableSize == 0) break;  // Fine stream, timeout o connessione chiusa
+
+    int bytesRead = stream->read(buff, min(availableSize, sizeof(buff)));
+    if (bytesRead <= 0) break;
+
+    // Scrivi su OTA partition
+    if (Update.write(buff, bytesRead) != (size_t)bytesRead) {
+      Serial.println("OTA write failed!");
+      Update.abort();
+      http.end();
+      return false;
+    }
 
-      currentLength += bytesRead;
+    currentLength += bytesRead;
 
-      // Progress ogni 100KB
-      if (currentLength % 102400 == 0) {
-        Serial.printf("OTA Progress: %d KB / %d KB (%d%%)\n",
-                      currentLength / 1024,
-                      totalLength / 1024,
-                      (currentLength * 100) / totalLength);
-      }
+    // Progress ogni 100KB
+    if (totalLength > 0 && currentLength % 102400 == 0) {
+      Serial.printf("OTA Progress: %d KB / %d KB (%d%%)\n",
+                    currentLength / 1024,
+                    totalLength / 1024,
+                    (currentLength * 100) / totalLength);
     }
-    delay(1);
   }
 
   http.end();
@@ -546,14 +2600,18 @@ void checkGitHubAndUpdate() {
     return;
   }
 
-  // 2. Mostra messaggio su display
-  displayMessage("Checking for updates...");
+  // 2. Mostra messaggio su display, solo se il pannello non ha un'immagine
+  //    (o un'anteprima) da conservare: il check gira a ogni wake
+  bool showProgress = (panelContent == PANEL_UNKNOWN);
+  if (showProgress) displayMessage("Checking for updates...");
 
   // 3. Connetti WiFi (prova tutte le reti disponibili)
   if (!connectToWiFi()) {
     Serial.println("Failed to connect to WiFi, skipping firmware update");
-    displayMessage("No WiFi - Continuing");
-    delay(1000);
+    if (showProgress) {
+      displayMessage("No WiFi - Continuing");
+      delay(1000);
+    }
     return;
   }
 
@@ -564,11 +2622,10 @@ void checkGitHubAndUpdate() {
 
   // 5. Download firmware.json da GitHub
   HTTPClient http;
-  String manifestURL = "https://raw.githubusercontent.com/" + String(GITHUB_USER) +
-                       "/" + String(GITHUB_REPO) + "/main/firmware.json";
+  String manifestURL = contentURL("firmware.json");
 
   Serial.printf("Checking version at: %s\n", manifestURL.c_str());
-  http.begin(manifestURL);
+  httpBegin(http, manifestURL);
   int httpCode = http.GET();
 
   if (httpCode != HTTP_CODE_OK) {
@@ -580,13 +2637,11 @@ void checkGitHubAndUpdate() {
   }
 
   // 6. Parse JSON per ottenere versione remota
-  String payload = http.getString();
+  String payload = httpGetString(http);
   http.end();
 
   // Parsing semplice del JSON (cerca "version")
-  int versionStart = payload.indexOf("\"version\":") + 11;
-  int versionEnd = payload.indexOf("\"", versionStart);
-  String remoteVersion = payload.substring(versionStart, versionEnd);
+  String remoteVersion = jsonStringValue(payload, "version");
 
   Serial.printf("Current version: %s\n", FIRMWARE_VERSION);
   Serial.printf("Remote version: %s\n", remoteVersion.c_str());
@@ -604,8 +2659,7 @@ void checkGitHubAndUpdate() {
   displayMessage("Downloading...", 300);
 
   // 8. Download e installa nuovo firmware via OTA
-  String binURL = "https://raw.githubusercontent.com/" + String(GITHUB_USER) +
-                  "/" + String(GITHUB_REPO) + "/main/MMpaper.bin";
+  String binURL = contentURL("MMpaper.bin");
 
   bool updateSuccess = downloadAndUpdateOTA(binURL.c_str());
 
@@ -641,8 +2695,8 @@ void smartRefresh() {
   if (!displayDirty) return;
 
   unsigned long now = millis();
-  bool canDoFullRefresh = (now - lastFullRefresh) >= FULL_REFRESH_MIN_INTERVAL;
-  bool needsGhostingFix = (partialRefreshCount >= PARTIAL_REFRESH_MAX_COUNT);
+  bool canDoFullRefresh = (now - lastFullRefresh) >= runtimeConfig.fullRefreshMinInterval;
+  bool needsGhostingFix = (partialRefreshCount >= runtimeConfig.partialRefreshMaxCount);
 
   if (needsGhostingFix && canDoFullRefresh) {
     // Full refresh
@@ -662,6 +2716,116 @@ void smartRefresh() {
   displayDirty = false;
 }
 
+// ===== BUTTON WAKE (FAST PATH) =====
+
+/**
+ * Cosa fare in questo wake, in base alla sorgente del risveglio
+ */
+enum WakeAction {
+  WAKE_SCHEDULED,   // Timer o reset: percorso normale (rete)
+  WAKE_REDRAW,      // Pulsante di ridisegno o linea MOTION_WAKE_PIN
+  WAKE_NEXT_IMAGE   // Pulsante avanti: playlist SD
+};
+
+/**
+ * Maschera ext1 di un pin (0 se disabilitato)
+ */
+uint64_t wakePinMask(int pin) {
+  return pin >= 0 ? (1ULL << pin) : 0;
+}
+
+/**
+ * Legge la causa del risveglio (ext0 = ridisegno, ext1 = pin in maschera)
+ */
+WakeAction getWakeAction() {
+  if (!ENABLE_BUTTON_WAKE) return WAKE_SCHEDULED;
+
+  switch (esp_sleep_get_wakeup_cause()) {
+    case ESP_SLEEP_WAKEUP_EXT0:
+      return WAKE_REDRAW;
+    case ESP_SLEEP_WAKEUP_EXT1:
+      if (esp_sleep_get_ext1_wakeup_status() & wakePinMask(BUTTON_NEXT_PIN)) {
+        return WAKE_NEXT_IMAGE;
+      }
+      return WAKE_REDRAW;
+    default:
+      return WAKE_SCHEDULED;
+  }
+}
+
+/**
+ * Percorso veloce da pulsante: solo slot flash e SD, nessuna radio
+ * Il display resta com'è se non c'è niente di locale da mostrare
+ */
+void handleButtonWake(WakeAction action) {
+  radioAllowed = false;
+
+  if (action == WAKE_NEXT_IMAGE) {
+    Serial.println("Button wake: next image");
+    if (sdLoadNextPlaylistImage()) {
+      displayImageFullscreen(epd_fast);
+      panelContent = PANEL_OTHER_IMAGE;  // Immagine della playlist, non quella dello slot
+      return;
+    }
+    Serial.println("No SD playlist, redrawing current image");
+  } else {
+    Serial.println("Button wake: redraw");
+  }
+
+  prefs.begin("mmconfig", true);
+  String localMD5 = prefs.getString("imageMD5", "");
+  prefs.end();
+
+  if (imageSlotLoadActive() || sdLoadImageByMD5(localMD5)) {
+    displayImageFullscreen();  // Qualità piena: pulisce il ghosting
+  } else {
+    Serial.println("No cached image to redraw");
+  }
+}
+
+/**
+ * Aspetta il rilascio di un pin di wake (wake a livello: ancora basso = risveglio immediato)
+ * Returns: false se il pin è disabilitato o resta basso (pulsante bloccato)
+ */
+bool waitWakePinReleased(int pin) {
+  if (pin < 0) return false;
+
+  pinMode(pin, INPUT);
+  unsigned long start = millis();
+  while (digitalRead(pin) == LOW) {
+    if (millis() - start > BUTTON_RELEASE_TIMEOUT) {
+      Serial.printf("Wake pin %d stuck low, ignored until next wake\n", pin);
+      return false;
+    }
+    delay(10);
+  }
+  return true;
+}
+
+/**
+ * Abilita i wake da pulsante/MOTION_WAKE_PIN (oltre al timer)
+ * ext0: un pin; ext1: maschera (ESP32: tutti bassi, ESP32-S3: uno qualsiasi basso)
+ * IDF 5 separa le due modalità (ALL_LOW esiste solo su ESP32), IDF 4 usa lo stesso valore
+ */
+void enableButtonWake() {
+  if (!ENABLE_BUTTON_WAKE) return;
+
+  if (waitWakePinReleased(BUTTON_REDRAW_PIN)) {
+    esp_sleep_enable_ext0_wakeup((gpio_num_t)BUTTON_REDRAW_PIN, 0);
+  }
+
+  uint64_t ext1Mask = 0;
+  if (waitWakePinReleased(BUTTON_NEXT_PIN)) ext1Mask |= wakePinMask(BUTTON_NEXT_PIN);
+  if (waitWakePinReleased(MOTION_WAKE_PIN)) ext1Mask |= wakePinMask(MOTION_WAKE_PIN);
+  if (ext1Mask != 0) {
+#if ESP_IDF_VERSION_MAJOR >= 5 && CONFIG_IDF_TARGET_ESP32S3
+    esp_sleep_enable_ext1_wakeup(ext1Mask, ESP_EXT1_WAKEUP_ANY_LOW);
+#else
+    esp_sleep_enable_ext1_wakeup(ext1Mask, ESP_EXT1_WAKEUP_ALL_LOW);
+#endif
+  }
+}
+
 // ===== DEEP SLEEP =====
 
 /**
@@ -674,45 +2838,36 @@ uint64_t getSecondsUntilNextImageCheck() {
     return 3600;
   }
 
-  int currentHour = timeinfo.tm_hour;
-  int currentMin = timeinfo.tm_min;
+  int nowSec = timeinfo.tm_hour * 3600 + timeinfo.tm_min * 60 + timeinfo.tm_sec;
+  int offset = fetchSlotOffset();
 
-  // Orari di check
-  const int checkHours[] = IMAGE_CHECK_HOURS;
-  const int numCheckHours = sizeof(checkHours) / sizeof(checkHours[0]);
-
-  // Trova prossimo orario di check
-  int nextCheckHour = -1;
-  for (int i = 0; i < numCheckHours; i++) {
-    if (checkHours[i] > currentHour ||
-        (checkHours[i] == currentHour && currentMin < 5)) {
-      nextCheckHour = checkHours[i];
-      break;
-    }
-  }
+  prefs.begin("mmconfig", true);
+  int lastCheckHour = prefs.getInt("lastCheckHour", -1);
+  int lastCheckDay = prefs.getInt("lastCheckDay", -1);
+  prefs.end();
 
-  // Se non troviamo check oggi, prendi il primo di domani
-  if (nextCheckHour == -1) {
-    nextCheckHour = checkHours[0];
-    // Calcola secondi fino a domani alle nextCheckHour
-    int hoursUntilMidnight = 24 - currentHour;
-    int minutesUntilMidnight = 60 - currentMin;
-    uint64_t secondsUntilMidnight = (hoursUntilMidnight * 3600) + (minutesUntilMidnight * 60);
-    uint64_t secondsAfterMidnight = nextCheckHour * 3600;
-    return secondsUntilMidnight + secondsAfterMidnight;
+  // Trova il prossimo slot (saltando quello appena fatto, se siamo in anticipo)
+  int secondsUntilCheck = 86400;
+  for (int hour = 0; hour < 24; hour++) {
+    if (!(runtimeConfig.checkHours & (1UL << hour))) continue;
+    int wait = (hour * 3600 + offset - nowSec + 86400) % 86400;
+    bool alreadyChecked = (hour == lastCheckHour && timeinfo.tm_mday == lastCheckDay);
+    if (wait < 60 && alreadyChecked) continue;
+    if (wait < secondsUntilCheck) secondsUntilCheck = wait;
   }
 
-  // Calcola secondi fino al prossimo check oggi
-  int hoursUntilCheck = nextCheckHour - currentHour;
-  int minutesUntilCheck = 0 - currentMin;  // Vogliamo arrivare a :00
-  uint64_t secondsUntilCheck = (hoursUntilCheck * 3600) + (minutesUntilCheck * 60);
+  // Jitter: device con lo stesso slot non arrivano insieme
+  int jitter = fetchJitterSeconds();
+  if (jitter > 0) {
+    secondsUntilCheck += esp_random() % (jitter + 1);
+  }
 
-  // Minimo 5 minuti di sleep
-  if (secondsUntilCheck < 300) {
-    secondsUntilCheck = 300;
+  // Minimo 1 minuto di sleep
+  if (secondsUntilCheck < 60) {
+    secondsUntilCheck = 60;
   }
 
-  Serial.printf("Next check in %llu seconds (~%llu minutes)\n",
+  Serial.printf("Next check in %d seconds (~%d minutes)\n",
                 secondsUntilCheck, secondsUntilCheck / 60);
 
   return secondsUntilCheck;
@@ -732,9 +2887,11 @@ void enterDeepSleep() {
   // Prepara deep sleep
   M5.Display.sleep();
   WiFi.mode(WIFI_OFF);
+  sdStoreEnd();
 
-  // Configura wakeup timer
+  // Configura wakeup: timer + pulsanti
   esp_sleep_enable_timer_wakeup(sleepSeconds * 1000000ULL);
+  enableButtonWake();
 
   // Vai in deep sleep
   esp_deep_sleep_start();
@@ -745,14 +2902,21 @@ void enterDeepSleep() {
 void setup() {
   // Inizializza seriale per debug
   Serial.begin(115200);
-  delay(1000);
 
   Serial.println("\n=== MMPAPER STARTING ===");
   Serial.printf("Firmware version: %s\n", FIRMWARE_VERSION);
+  Serial.printf("Device ID: %s\n", deviceId().c_str());
+
+  // Fuso orario prima di qualsiasi calcolo sugli slot (anche wake da pulsante)
+  setLocalTimezone();
+
+  // Runtime config da NVS (default di config.h se assente)
+  loadRuntimeConfig();
 
   // Inizializza M5Unified
   auto cfg = M5.config();
   cfg.internal_imu = ENABLE_IMU;  // Disabilita IMU
+  cfg.clear_display = false;      // Il pannello conserva l'immagine (vedi panelContent)
   M5.begin(cfg);
 
   // Imposta orientamento VERTICALE (portrait) con bordo largo in basso
@@ -760,6 +2924,16 @@ void setup() {
 
   Serial.println("M5Unified initialized (portrait mode)");
 
+  initPowerManagement();
+
+  // 0. Wake da pulsante: percorso veloce senza radio, poi subito a dormire
+  WakeAction wakeAction = getWakeAction();
+  if (wakeAction != WAKE_SCHEDULED) {
+    handleButtonWake(wakeAction);
+    Serial.flush();
+    enterDeepSleep();
+  }
+
   // 1. FIRMWARE UPDATE CHECK (solo al boot)
   if (shouldCheckFirmwareUpdate()) {
     Serial.println("Checking for firmware update...");
@@ -775,18 +2949,48 @@ void setup() {
     isFirstBoot = false;
   }
 
-  // 3. Se non abbiamo immagine, prova a scaricare l'immagine corrente
-  if (imageBuffer == nullptr) {
-    Serial.println("No new image downloaded, attempting to download current image");
-
-    if (connectToWiFi()) {
-      downloadImage();
+  // 3. Se non abbiamo immagine: slot flash → mirror SD → download → playlist SD offline
+  if (imageBuffer == nullptr && !previewDisplayed) {
+    prefs.begin("mmconfig", true);
+    String localMD5 = prefs.getString("imageMD5", "");
+    String previewMD5 = prefs.getString("previewMD5", "");
+    prefs.end();
+
+    if (previewMD5.length() > 0 && panelContent == PANEL_PREVIEW) {
+      // Anteprima della nuova immagine ancora a schermo: non ridisegnare la vecchia
+      Serial.println("Preview on screen, waiting for full image");
+    } else if (!networkUnavailable && panelContent == PANEL_ACTIVE_IMAGE) {
+      // Il pannello mostra già l'immagine corrente (e-ink: resta in deep sleep)
+      Serial.println("Current image already on screen");
+    } else if (!networkUnavailable && panelContent == PANEL_OTHER_IMAGE) {
+      // Immagine scelta dalla playlist SD: resta fino alla prossima immagine nuova
+      Serial.println("SD playlist image on screen, keeping it");
+    } else if (!networkUnavailable && imageSlotLoadActive()) {
+      // Ultima immagine buona in flash: zero rete, niente SD
+      Serial.println("Current image loaded from flash slot");
+      displayImageFullscreen();
+    } else if (!networkUnavailable && sdLoadImageByMD5(localMD5)) {
+      // Immagine corrente già sulla SD: zero traffico di rete
+      Serial.println("Current image loaded from SD mirror");
+      displayImageFullscreen();
+    } else if (!networkUnavailable && connectToWiFi()) {
+      Serial.println("No new image downloaded, attempting to download current image");
+      bool downloaded = downloadImage();
       WiFi.disconnect(true);
       WiFi.mode(WIFI_OFF);
 
-      if (imageBuffer != nullptr) {
-        displayImageFullscreen();
+      if (downloaded && installImage("")) {
+        String md5 = imageBufferMD5();
+        prefs.begin("mmconfig", false);
+        prefs.putString("imageMD5", md5);  // Il prossimo check non lo riscarica
+        prefs.end();
+        sdMirrorImage(md5);
       }
+    } else if (sdLoadNextPlaylistImage()) {
+      // Offline: mostra la prossima immagine della collezione SD
+      Serial.println("Offline - showing next image from SD playlist");
+      displayImageFullscreen();
+      panelContent = PANEL_OTHER_IMAGE;  // Immagine della playlist, non quella dello slot
     } else {
       Serial.println("No WiFi available, skipping image display");
     }
@@ -794,7 +2998,7 @@ void setup() {
 
   // 4. Entra in deep sleep fino al prossimo check
   Serial.println("Setup complete, entering deep sleep...");
-  delay(100);  // Dai tempo al serial di inviare
+  Serial.flush();  // Dai tempo al serial di inviare
   enterDeepSleep();
 }
 
@@ -3,13 +3,27 @@
 
 set -e
 
+TILED=false
+DIR="image"
+while [ $# -gt 0 ]; do
+    case "$1" in
+        --tiled) TILED=true; shift ;;
+        --dir) DIR="${2%/}"; shift 2 ;;
+        *) break ;;
+    esac
+done
+
 if [ $# -eq 0 ]; then
-    echo "Usage: ./update_image.sh <image_path> [description]"
+    echo "Usage: ./update_image.sh [--tiled] [--dir DIR] <image_path> [description]"
     echo ""
     echo "Example:"
     echo "  ./update_image.sh my_photo.jpg \"Sunset in Rome\""
+    echo "  ./update_image.sh --tiled dashboard.png \"Dashboard\""
+    echo "  ./update_image.sh --dir image/kitchen menu.jpg \"Menu\""
     echo ""
     echo "Note: Image will be resized to 960x540 for M5PaperS3 display"
+    echo "      --tiled also publishes current.mmt: devices fetch only changed tiles"
+    echo "      --dir publishes to a manifest target folder (default: image)"
     exit 1
 fi
 
@@ -21,7 +35,8 @@ if [ ! -f "$IMAGE_PATH" ]; then
     exit 1
 fi
 
-echo "📸 Processing image: $IMAGE_PATH"
+echo "📸 Processing image: $IMAGE_PATH → $DIR/"
+mkdir -p "$DIR"
 
 # Check if ImageMagick is installed
 if command -v convert &> /dev/null; then
@@ -42,28 +57,108 @@ if command -v convert &> /dev/null; then
         -gravity center \
         -extent 960x540 \
         -quality 90 \
-        image/current.jpg
+        $DIR/current.jpg
 
     echo "   ✅ Processed to 960x540 (no distortion)"
+
+    # Layered format: low-res preview + full JPEG in one file ($DIR/current.mmp)
+    # Header: "MMPL" + preview size + full size + reserved (uint32 little-endian)
+    # Baseline JPEG (-interlace none): the device decoder doesn't support progressive
+    echo "🔧 Generating layered image (preview + full)..."
+    PREVIEW_TMP=$(mktemp -t mmpaper_preview.XXXXXX)
+    convert $DIR/current.jpg \
+        -resize 25% \
+        -interlace none \
+        -quality 60 \
+        "jpg:$PREVIEW_TMP"
+
+    le32() {
+        printf '\\x%02x\\x%02x\\x%02x\\x%02x' \
+            $(($1 & 255)) $((($1 >> 8) & 255)) $((($1 >> 16) & 255)) $((($1 >> 24) & 255))
+    }
+    PREVIEW_SIZE=$(wc -c < "$PREVIEW_TMP" | tr -d ' ')
+    FULL_SIZE=$(wc -c < $DIR/current.jpg | tr -d ' ')
+    {
+        printf "MMPL"
+        printf "$(le32 $PREVIEW_SIZE)"
+        printf "$(le32 $FULL_SIZE)"
+        printf "$(le32 0)"
+        cat "$PREVIEW_TMP" $DIR/current.jpg
+    } > $DIR/current.mmp
+    rm -f "$PREVIEW_TMP"
+    FORMAT="layered"
+
+    echo "   ✅ Layered: preview $PREVIEW_SIZE bytes + full $FULL_SIZE bytes"
+
+    # Tiled format: 540x960 panel-native tiles (same crop as the device) in
+    # $DIR/current.mmt. Tiles with unchanged pixels keep the same bytes (-strip),
+    # so devices download only what changed (HTTP Range)
+    if [ "$TILED" = true ]; then
+        echo "🔧 Generating tiled image (135x120 tiles)..."
+        TILES_TMP=$(mktemp -d -t mmpaper_tiles.XXXXXX)
+        convert $DIR/current.jpg \
+            -resize 540x960^ \
+            -gravity center \
+            -extent 540x960 \
+            +gravity \
+            -crop 135x120 +repage \
+            -strip \
+            -interlace none \
+            -quality 90 \
+            "$TILES_TMP/tile_%02d.jpg"
+        python3 make_tiles.py --panel 540x960 --tile 135x120 $DIR/current.mmt "$TILES_TMP"/tile_*.jpg
+        rm -rf "$TILES_TMP"
+        FORMAT="tiled"
+
+        echo "   ✅ Tiled: $(wc -c < $DIR/current.mmt | tr -d ' ') bytes"
+    else
+        rm -f $DIR/current.mmt
+    fi
 else
     echo "⚠️  ImageMagick not installed, copying without resize"
     echo "   Install with: brew install imagemagick"
     echo "   Note: Image may not display correctly if wrong size"
-    cp "$IMAGE_PATH" image/current.jpg
+    cp "$IMAGE_PATH" $DIR/current.jpg
+    rm -f $DIR/current.mmp $DIR/current.mmt
+    FORMAT="jpeg"
 fi
 
 # Generate metadata
 echo "📝 Generating metadata..."
 TIMESTAMP=$(date -u +%Y-%m-%dT%H:%M:%SZ)
-MD5=$(md5 -q image/current.jpg)
+MD5=$(md5 -q $DIR/current.jpg)
 
-cat > image/image_meta.json <<EOF
-{
-  "updated": "$TIMESTAMP",
-  "md5": "$MD5",
-  "description": "$DESCRIPTION"
-}
-EOF
+# "md5" is always current.jpg (older firmware), "tiles_md5" is the tiled container
+TILES_MD5=""
+if [ -f "$DIR/current.mmt" ]; then
+    TILES_MD5=$(md5 -q "$DIR/current.mmt")
+fi
+
+# Fleet keys already in the manifest ("targets", "window_minutes", "jitter_seconds",
+# "config_seq" of make_config.py) are kept
+python3 - "$DIR/image_meta.json" "$TIMESTAMP" "$MD5" "$TILES_MD5" "$FORMAT" "$DESCRIPTION" <<'META'
+import json, os, sys
+path, updated, md5, tiles_md5, fmt, description = sys.argv[1:]
+meta = {"updated": updated, "md5": md5}
+if tiles_md5:
+    meta["tiles_md5"] = tiles_md5
+meta.update({"format": fmt, "description": description})
+if os.path.exists(path):
+    with open(path) as f:
+        old = json.load(f)
+    meta.update({k: old[k] for k in ("window_minutes", "jitter_seconds", "targets", "config_seq") if k in old})
+with open(path, "w") as f:
+    json.dump(meta, f, indent=2)
+    f.write("\n")
+META
+
+IMAGE_FILES="$DIR/current.jpg $DIR/image_meta.json"
+if [ -f $DIR/current.mmp ]; then
+    IMAGE_FILES="$IMAGE_FILES $DIR/current.mmp"
+fi
+if [ -f $DIR/current.mmt ]; then
+    IMAGE_FILES="$IMAGE_FILES $DIR/current.mmt"
+fi
 
 echo ""
 echo "✅ Image prepared!"
@@ -71,7 +166,7 @@ echo "   Updated: $TIMESTAMP"
 echo "   MD5: $MD5"
 echo ""
 echo "Next steps:"
-echo "  git add image/current.jpg image/image_meta.json"
+echo "  git add $IMAGE_FILES"
 echo "  git commit -m \"Update display: $DESCRIPTION\""
 echo "  git push"
 echo ""
@@ -80,7 +175,7 @@ echo ""
 read -p "Auto-commit and push? (y/N): " -n 1 -r
 echo
 if [[ $REPLY =~ ^[Yy]$ ]]; then
-    git add image/current.jpg image/image_meta.json
+    git add $IMAGE_FILES
     git commit -m "Update display: $DESCRIPTION"
     git push
     echo ""